@@ -22,7 +22,7 @@
 #define FFMS_H
 
 // Version format: major - minor - micro - bump
-#define FFMS_VERSION ((5 << 24) | (1 << 16) | (2 << 8) | 0)
+#define FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0)
 
 #include <stdint.h>
 #include <stddef.h>
@@ -115,6 +115,7 @@ typedef enum FFMS_Errors {
     FFMS_ERROR_WAVE_WRITER,			// WAVE64 file writer
     FFMS_ERROR_CANCELLED,			// operation aborted
     FFMS_ERROR_RESAMPLING,			// audio resampling (libavresample)
+    FFMS_ERROR_TRACE,				// trace event output, introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0)
 
     // Subtypes - what caused the error
     FFMS_ERROR_UNKNOWN = 20,		// unknown error
@@ -139,6 +140,11 @@ typedef enum FFMS_SeekMode {
     FFMS_SEEK_AGGRESSIVE = 3
 } FFMS_SeekMode;
 
+typedef enum FFMS_LayeredViews {
+    FFMS_VIEWS_ALL = -1,
+    FFMS_VIEWS_PRIMARY = -2
+} FFMS_LayeredViews;
+
 typedef enum FFMS_IndexErrorHandling {
     FFMS_IEH_ABORT = 0,
     FFMS_IEH_CLEAR_TRACK = 1,
@@ -243,6 +249,26 @@ typedef enum FFMS_Stereo3DFlags {
     FFMS_S3D_FLAGS_INVERT = 1
 } FFMS_Stereo3DFlags;
 
+typedef enum FFMS_FrameMetadata {
+    FFMS_METADATA_MASTERING_DISPLAY = 0x01,
+    FFMS_METADATA_CONTENT_LIGHT_LEVEL = 0x02,
+    FFMS_METADATA_DOLBY_VISION_RPU = 0x04,
+    FFMS_METADATA_HDR10PLUS = 0x08,
+    FFMS_METADATA_ALL = 0x0F
+} FFMS_FrameMetadata;
+
+typedef enum FFMS_DecodeProfile {
+    FFMS_DECODE_EXACT = 0,
+    FFMS_DECODE_FAST = 1,
+    FFMS_DECODE_PREVIEW = 2
+} FFMS_DecodeProfile;
+
+typedef enum FFMS_ThreadingMode {
+    FFMS_THREADING_FRAME = 0,
+    FFMS_THREADING_SLICE = 1,
+    FFMS_THREADING_AUTO = 2
+} FFMS_ThreadingMode;
+
 typedef enum FFMS_MixingCoefficientType {
     FFMS_MIXING_COEFFICIENT_Q8 = 0,
     FFMS_MIXING_COEFFICIENT_Q15 = 1,
@@ -423,12 +449,74 @@ typedef struct FFMS_AudioProperties {
     double LastEndTime;
 } FFMS_AudioProperties;
 
+/* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+typedef struct FFMS_VideoSourceStats {
+    int64_t Seeks;
+    int64_t FailedSeeks;
+    int64_t PacketsRead;
+    int64_t BytesRead;
+    int64_t CachedSeeks;
+    int64_t CachedPackets;
+    int64_t FramesDecoded;
+    int64_t FramesReturned;
+    int64_t ThreadingSwitches;
+    double DemuxTime; /* All times are in seconds */
+    double DecodeTime;
+    double ConvertTime;
+    double MetadataTime;
+} FFMS_VideoSourceStats;
+
+/* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+typedef struct FFMS_AudioSourceStats {
+    int64_t Seeks;
+    int64_t PacketsRead;
+    int64_t BytesRead;
+    int64_t FramesDecoded;
+    int64_t CacheHits;
+    int64_t CacheMisses;
+    int64_t CacheMemory; /* In bytes */
+    double DemuxTime; /* All times are in seconds */
+    double DecodeTime;
+    double ResampleTime;
+} FFMS_AudioSourceStats;
+
+/* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+typedef struct FFMS_MemoryUsage {
+    int64_t Limit; /* 0 if unlimited */
+    int64_t Total;
+    int64_t VideoFrameCaches;
+    int64_t AudioCaches;
+    int64_t Decoders; /* Estimated from the frame size and number of threads */
+    int64_t SharedDemuxers;
+} FFMS_MemoryUsage;
+
+/* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+typedef struct FFMS_PacketInfo {
+    int64_t PTS; /* As stored in the file, in the track's time base */
+    int64_t DTS;
+    int64_t Duration;
+    int64_t FilePos; /* -1 if unknown */
+    int KeyFrame;
+} FFMS_PacketInfo;
+
+/* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+typedef struct FFMS_Input {
+    /* Either the whole file in memory... */
+    const uint8_t *Buffer;
+    int64_t BufferSize;
+    /* ...or callbacks reading it, only used when Buffer is NULL */
+    int (FFMS_CC *Read)(void *Private, int64_t Offset, uint8_t *Buf, int Size); /* Returns the number of bytes read, 0 at the end and negative on errors */
+    int64_t (FFMS_CC *GetSize)(void *Private); /* Optional, negative if unknown */
+    void *Private;
+} FFMS_Input;
+
 typedef struct FFMS_KeyValuePair {
     const char *Key;
     const char *Value;
 } FFMS_KeyValuePair;
 
 typedef int (FFMS_CC *TIndexCallback)(int64_t Current, int64_t Total, void *ICPrivate);
+typedef int (FFMS_CC *TFrameCallback)(const FFMS_Frame *Frame, int n, void *Private);
 
 /* Most functions return 0 on success */
 /* Functions without error message output can be assumed to never fail in a graceful way */
@@ -436,20 +524,50 @@ FFMS_API(void) FFMS_Init(int, int); /* Pass 0 to both arguments, kept to partial
 FFMS_API(int) FFMS_GetVersion();
 FFMS_API(int) FFMS_GetLogLevel();
 FFMS_API(void) FFMS_SetLogLevel(int Level);
+FFMS_API(int) FFMS_SetTraceFile(const char *Filename, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetMemoryLimit(int64_t Bytes, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_GetMemoryUsage(FFMS_MemoryUsage *Usage); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_SetDemuxerSharing(int Enable); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_SetMemoryMappedInput(int Enable); /* Truncating a mapped file while in use raises SIGBUS outside of Windows. Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetReadAhead(int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSource(const char *SourceFile, int Track, FFMS_Index *Index, int Threads, int SeekMode, FFMS_ErrorInfo *ErrorInfo);
+FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSource2(const char *SourceFile, int Track, FFMS_Index *Index, int Threads, int SeekMode, int Views, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(FFMS_AudioSource *) FFMS_CreateAudioSource(const char *SourceFile, int Track, FFMS_Index *Index, int DelayMode, FFMS_ErrorInfo *ErrorInfo);
 FFMS_API(FFMS_AudioSource *) FFMS_CreateAudioSource2(const char *SourceFile, int Track, FFMS_Index *Index, int DelayMode, int FillGaps, double DrcScale, FFMS_ErrorInfo *ErrorInfo);
+FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSourceFromInput(const char *Name, const FFMS_Input *Input, int Track, FFMS_Index *Index, int Threads, int SeekMode, int Views, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(FFMS_AudioSource *) FFMS_CreateAudioSourceFromInput(const char *Name, const FFMS_Input *Input, int Track, FFMS_Index *Index, int DelayMode, int FillGaps, double DrcScale, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(void) FFMS_DestroyVideoSource(FFMS_VideoSource *V);
 FFMS_API(void) FFMS_DestroyAudioSource(FFMS_AudioSource *A);
 FFMS_API(const FFMS_VideoProperties *) FFMS_GetVideoProperties(FFMS_VideoSource *V);
 FFMS_API(const FFMS_AudioProperties *) FFMS_GetAudioProperties(FFMS_AudioSource *A);
 FFMS_API(const FFMS_Frame *) FFMS_GetFrame(FFMS_VideoSource *V, int n, FFMS_ErrorInfo *ErrorInfo);
 FFMS_API(const FFMS_Frame *) FFMS_GetFrameByTime(FFMS_VideoSource *V, double Time, FFMS_ErrorInfo *ErrorInfo);
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameInto(FFMS_VideoSource *V, int n, uint8_t * const *DstData, const int *DstLinesize, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameByTimeInto(FFMS_VideoSource *V, double Time, uint8_t * const *DstData, const int *DstLinesize, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameRef(FFMS_VideoSource *V, int n, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_ReleaseFrame(const FFMS_Frame *Frame); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_GetFrames(FFMS_VideoSource *V, int First, int Last, int Step, TFrameCallback Callback, void *Private, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(const FFMS_Frame *) FFMS_GetNearestKeyFrame(FFMS_VideoSource *V, int n, int *KeyFrameNumber, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_GetPacket(FFMS_VideoSource *V, int n, const uint8_t **Data, int *Size, FFMS_PacketInfo *Info, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_GetVideoExtradata(FFMS_VideoSource *V, const uint8_t **Data, int *Size); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(int) FFMS_GetAudio(FFMS_AudioSource *A, void *Buf, int64_t Start, int64_t Count, FFMS_ErrorInfo *ErrorInfo);
 FFMS_API(int) FFMS_SetOutputFormatV2(FFMS_VideoSource *V, const int *TargetFormats, int Width, int Height, int Resizer, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (3 << 8) | 0) */
 FFMS_API(void) FFMS_ResetOutputFormatV(FFMS_VideoSource *V);
 FFMS_API(int) FFMS_SetInputFormatV(FFMS_VideoSource *V, int ColorSpace, int ColorRange, int Format, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (17 << 16) | (1 << 8) | 0) */
 FFMS_API(void) FFMS_ResetInputFormatV(FFMS_VideoSource *V);
+FFMS_API(int) FFMS_SetVideoCacheSize(FFMS_VideoSource *V, int64_t MaxSize, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoPacketCacheSize(FFMS_VideoSource *V, int64_t MaxSize, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoDecoderPoolSize(FFMS_VideoSource *V, int NumDecoders, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoReadAhead(FFMS_VideoSource *V, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoPrefetch(FFMS_VideoSource *V, int NumFrames, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoConversionThreads(FFMS_VideoSource *V, int Threads, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoFrameMetadata(FFMS_VideoSource *V, int Mask, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoDecodeProfile(FFMS_VideoSource *V, int Profile, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetVideoThreadingMode(FFMS_VideoSource *V, int Mode, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_GetVideoSeekCosts(FFMS_VideoSource *V, double *FrameTime, double *SeekTime); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_GetVideoSourceStats(FFMS_VideoSource *V, FFMS_VideoSourceStats *Stats); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_GetAudioSourceStats(FFMS_AudioSource *A, FFMS_AudioSourceStats *Stats); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetAudioReadAhead(FFMS_AudioSource *A, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(FFMS_ResampleOptions *) FFMS_CreateResampleOptions(FFMS_AudioSource *A); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
 FFMS_API(int) FFMS_SetOutputFormatA(FFMS_AudioSource *A, const FFMS_ResampleOptions*options, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
 FFMS_API(void) FFMS_DestroyResampleOptions(FFMS_ResampleOptions *options); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
@@ -473,9 +591,12 @@ FFMS_API(const FFMS_TrackTimeBase *) FFMS_GetTimeBase(FFMS_Track *T);
 FFMS_API(int) FFMS_WriteTimecodes(FFMS_Track *T, const char *TimecodeFile, FFMS_ErrorInfo *ErrorInfo);
 FFMS_API(FFMS_Indexer *) FFMS_CreateIndexer(const char *SourceFile, FFMS_ErrorInfo *ErrorInfo);
 FFMS_API(FFMS_Indexer *) FFMS_CreateIndexer2(const char *SourceFile, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions, FFMS_ErrorInfo *ErrorInfo);
+FFMS_API(FFMS_Indexer *) FFMS_CreateIndexerFromInput(const char *Name, const FFMS_Input *Input, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(void) FFMS_TrackIndexSettings(FFMS_Indexer *Indexer, int Track, int Index, int); /* Pass 0 to last argument, kapt to preserve abi. Introduced in FFMS_VERSION ((2 << 24) | (21 << 16) | (0 << 8) | 0) */
 FFMS_API(void) FFMS_TrackTypeIndexSettings(FFMS_Indexer *Indexer, int TrackType, int Index, int); /* Pass 0 to last argument, kapt to preserve abi. Introduced in FFMS_VERSION ((2 << 24) | (21 << 16) | (0 << 8) | 0) */
 FFMS_API(void) FFMS_SetProgressCallback(FFMS_Indexer *Indexer, TIndexCallback IC, void *ICPrivate); /* Introduced in FFMS_VERSION ((2 << 24) | (21 << 16) | (0 << 8) | 0) */
+FFMS_API(void) FFMS_SetSeekPointVerification(FFMS_Indexer *Indexer, int Verify); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetIndexerReadAhead(FFMS_Indexer *Indexer, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((5 << 24) | (2 << 16) | (0 << 8) | 0) */
 FFMS_API(FFMS_Index *) FFMS_DoIndexing2(FFMS_Indexer *Indexer, int ErrorHandling, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (21 << 16) | (0 << 8) | 0) */
 FFMS_API(void) FFMS_CancelIndexing(FFMS_Indexer *Indexer);
 FFMS_API(FFMS_Index *) FFMS_ReadIndex(const char *IndexFile, FFMS_ErrorInfo *ErrorInfo);
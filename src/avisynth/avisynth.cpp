@@ -105,6 +105,7 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     const char *Resizer = Args[12].AsString("BICUBIC");
     const char *ColorSpace = Args[13].AsString("");
     const char *VarPrefix = Args[14].AsString("");
+    int Views = Args[15].AsInt(FFMS_VIEWS_ALL);
 
     if (FPSDen < 1)
         Env->ThrowError("FFVideoSource: FPS denominator needs to be 1 or higher");
@@ -118,6 +119,9 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     if (RFFMode != 0)
         Env->ThrowError("FFVideoSource: Invalid RFF mode selected");
 
+    if (Views < FFMS_VIEWS_PRIMARY)
+        Env->ThrowError("FFVideoSource: Invalid view selected");
+
     if (IsSamePath(Source, Timecodes))
         Env->ThrowError("FFVideoSource: Timecodes will overwrite the source");
 
@@ -174,7 +178,7 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     AvisynthVideoSource *Filter;
 
     try {
-        Filter = new AvisynthVideoSource(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, Width, Height, Resizer, ColorSpace, VarPrefix, Env);
+        Filter = new AvisynthVideoSource(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, Views, Width, Height, Resizer, ColorSpace, VarPrefix, Env);
     } catch (...) {
         FFMS_DestroyIndex(Index);
         throw;
@@ -285,6 +289,16 @@ static AVSValue __cdecl CreateFFAudioSource(AVSValue Args, void* UserData, IScri
     return Filter;
 }
 
+// Shares demuxers between the sources created by the current thread while in scope
+struct DemuxerSharingScope {
+    explicit DemuxerSharingScope(bool Enable) {
+        FFMS_SetDemuxerSharing(Enable);
+    }
+    ~DemuxerSharingScope() {
+        FFMS_SetDemuxerSharing(0);
+    }
+};
+
 static AVSValue __cdecl CreateFFmpegSource2(AVSValue Args, void* UserData, IScriptEnvironment* Env) {
     const char *FFIArgNames[] = { "source", "cachefile", "indexmask", "overwrite", "enable_drefs", "use_absolute_path"};
     const char *FFVArgNames[] = { "source", "track", "cache", "cachefile", "fpsnum", "fpsden", "threads", "timecodes", "seekmode", "rffmode", "width", "height", "resizer", "colorspace", "varprefix" };
@@ -298,6 +312,9 @@ static AVSValue __cdecl CreateFFmpegSource2(AVSValue Args, void* UserData, IScri
         Env->Invoke("FFIndex", AVSValue(FFIArgs, sizeof(FFIArgs) / sizeof(FFIArgs[0])), FFIArgNames);
     }
 
+    // The audio and video of the same file are opened so let them read it only once, a lone video source has nothing to share with
+    DemuxerSharingScope Sharing(WithAudio);
+
     AVSValue FFVArgs[] = { Args[0], Args[1], Args[3], Args[4], Args[5], Args[6], Args[7], Args[8], Args[9], Args[15], Args[11], Args[12], Args[13], Args[14], Args[21] };
     static_assert((sizeof(FFVArgs) / sizeof(FFVArgs[0])) == (sizeof(FFVArgNames) / sizeof(FFVArgNames[0])), "Arg error");
     AVSValue Video = Env->Invoke("FFVideoSource", AVSValue(FFVArgs, sizeof(FFVArgs) / sizeof(FFVArgs[0])), FFVArgNames);
@@ -348,7 +365,7 @@ extern "C" AVS_EXPORT const char* __stdcall AvisynthPluginInit3(IScriptEnvironme
     AVS_linkage = vectors;
 
     Env->AddFunction("FFIndex", "[source]s[cachefile]s[indexmask]i[errorhandling]i[overwrite]b[enable_drefs]b[use_absolute_path]b", CreateFFIndex, nullptr);
-    Env->AddFunction("FFVideoSource", "[source]s[track]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[rffmode]i[width]i[height]i[resizer]s[colorspace]s[varprefix]s", CreateFFVideoSource, nullptr);
+    Env->AddFunction("FFVideoSource", "[source]s[track]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[rffmode]i[width]i[height]i[resizer]s[colorspace]s[varprefix]s[view]i", CreateFFVideoSource, nullptr);
     Env->AddFunction("FFAudioSource", "[source]s[track]i[cache]b[cachefile]s[adjustdelay]i[fill_gaps]i[drc_scale]f[varprefix]s", CreateFFAudioSource, nullptr);
 
     Env->AddFunction("FFmpegSource2", "[source]s[vtrack]i[atrack]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[overwrite]b[width]i[height]i[resizer]s[colorspace]s[rffmode]i[adjustdelay]i[enable_drefs]b[use_absolute_path]b[fill_gaps]i[drc_scale]f[varprefix]s", CreateFFmpegSource2, nullptr);
@@ -114,12 +114,13 @@ static AVPixelFormat CSNameToPIXFMT(const char *CSName, AVPixelFormat Default, b
 }
 
 AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS_Index *Index,
-    int AFPSNum, int AFPSDen, int Threads, int SeekMode,
+    int AFPSNum, int AFPSDen, int Threads, int SeekMode, int Views,
     int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
     const char *ConvertToFormatName, const char *VarPrefix, IScriptEnvironment* Env)
     : FPSNum(AFPSNum)
     , FPSDen(AFPSDen)
-    , VarPrefix(VarPrefix) {
+    , VarPrefix(VarPrefix)
+    , DirectOutput(false) {
     VI = {};
 
     // check if the two functions we need for many bits are present
@@ -128,7 +129,7 @@ AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS
     VI.pixel_type = VideoInfo::CS_UNKNOWN;
 
     ErrorInfo E;
-    V = FFMS_CreateVideoSource(SourceFile, Track, Index, Threads, SeekMode, &E);
+    V = FFMS_CreateVideoSource2(SourceFile, Track, Index, Threads, SeekMode, Views, &E);
     if (!V)
         Env->ThrowError("FFVideoSource: %s", E.Buffer);
 
@@ -379,6 +380,34 @@ void AvisynthVideoSource::InitOutputFormat(
     // Crop to obey subsampling width/height requirements
     VI.width -= VI.width % (1 << GetSubSamplingW(VI));
     VI.height -= VI.height % (1 << (GetSubSamplingH(VI)));
+
+    // Cropped frames and the eyes of layered video need an intermediate copy, everything else can be converted straight into the output
+    DirectOutput = VI.width == F->ScaledWidth && VI.height == F->ScaledHeight && !F->LeftEyeData[0];
+}
+
+void AvisynthVideoSource::GetOutputPlanes(PVideoFrame &Dst, uint8_t **Planes, int *Strides) {
+    auto SetPlane = [&](int Plane, int PlaneId) {
+        Planes[Plane] = Dst->GetWritePtr(PlaneId);
+        Strides[Plane] = Dst->GetPitch(PlaneId);
+    };
+
+    if (VI.IsPlanar()) {
+        SetPlane(0, VI.IsRGB() ? PLANAR_G : PLANAR_Y);
+        if (HighBitDepth ? !VI.IsY() : !VI.IsY8()) {
+            SetPlane(1, VI.IsRGB() ? PLANAR_B : PLANAR_U);
+            SetPlane(2, VI.IsRGB() ? PLANAR_R : PLANAR_V);
+        }
+        if (VI.IsYUVA() || VI.IsPlanarRGBA())
+            SetPlane(3, PLANAR_A);
+    } else if (VI.IsYUY2()) {
+        SetPlane(0, 0);
+    } else if (VI.IsRGB24() || VI.IsRGB32()) {
+        // Packed RGB is stored bottom-up
+        Planes[0] = Dst->GetWritePtr() + Dst->GetPitch() * (Dst->GetHeight() - 1);
+        Strides[0] = -Dst->GetPitch();
+    } else {
+        assert(false);
+    }
 }
 
 static void BlitPlane(const FFMS_Frame *Frame, PVideoFrame &Dst, IScriptEnvironment *Env, int Plane, int PlaneId) {
@@ -446,10 +475,18 @@ PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
     ErrorInfo E;
     const FFMS_Frame *Frame = nullptr;
 
+    uint8_t *DstPlanes[4] = {};
+    int DstStrides[4] = {};
+    if (DirectOutput)
+        GetOutputPlanes(Dst, DstPlanes, DstStrides);
+
     if (FPSNum > 0 && FPSDen > 0) {
         double currentTime = FFMS_GetVideoProperties(V)->FirstTime +
             (double)(n * (int64_t)FPSDen) / FPSNum;
-        Frame = FFMS_GetFrameByTime(V, currentTime, &E);
+        if (DirectOutput)
+            Frame = FFMS_GetFrameByTimeInto(V, currentTime, DstPlanes, DstStrides, &E);
+        else
+            Frame = FFMS_GetFrameByTime(V, currentTime, &E);
         Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFVFR_TIME"), -1);
         if (has_at_least_v8) {
             Env->propSetInt(props, "_DurationNum", FPSDen, 0);
@@ -457,7 +494,10 @@ PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
             Env->propSetFloat(props, "_AbsoluteTime", currentTime, 0);
         }
     } else {
-        Frame = FFMS_GetFrame(V, n, &E);
+        if (DirectOutput)
+            Frame = FFMS_GetFrameInto(V, n, DstPlanes, DstStrides, &E);
+        else
+            Frame = FFMS_GetFrame(V, n, &E);
         FFMS_Track *T = FFMS_GetTrackFromVideo(V);
         const FFMS_TrackTimeBase *TB = FFMS_GetTimeBase(T);
         Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFVFR_TIME"), static_cast<int>(FFMS_GetFrameInfo(T, n)->PTS * static_cast<double>(TB->Num) / TB->Den));
@@ -482,7 +522,8 @@ PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
         Env->ThrowError("FFVideoSource: %s", E.Buffer);
 
     Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFPICT_TYPE"), static_cast<int>(Frame->PictType));
-    OutputFrame(Frame, Dst, Env);
+    if (!DirectOutput)
+        OutputFrame(Frame, Dst, Env);
 
     if (has_at_least_v8) {
         const FFMS_VideoProperties *VP = FFMS_GetVideoProperties(V);
@@ -44,14 +44,16 @@ class AvisynthVideoSource : public IClip {
     int64_t FPSDen;
     const char *VarPrefix;
     bool has_at_least_v8;
+    bool DirectOutput;
 
     void InitOutputFormat(int ResizeToWidth, int ResizeToHeight,
         const char *ResizerName, const char *ConvertToFormatName, IScriptEnvironment *Env);
+    void GetOutputPlanes(PVideoFrame &Dst, uint8_t **Planes, int *Strides);
     void OutputFrame(const FFMS_Frame *Frame, PVideoFrame &Dst, IScriptEnvironment *Env);
     void OutputField(const FFMS_Frame *Frame, PVideoFrame &Dst, int Field, IScriptEnvironment *Env);
 public:
     AvisynthVideoSource(const char *SourceFile, int Track, FFMS_Index *Index,
-        int FPSNum, int FPSDen, int Threads, int SeekMode,
+        int FPSNum, int FPSDen, int Threads, int SeekMode, int Views,
         int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
         const char *ConvertToFormatName, const char *VarPrefix, IScriptEnvironment* Env);
     ~AvisynthVideoSource();
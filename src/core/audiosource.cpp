@@ -21,6 +21,8 @@
 #include "audiosource.h"
 
 #include "indexing.h"
+#include "inputreader.h"
+#include "trace.h"
 
 #include <algorithm>
 #include <cassert>
@@ -53,8 +55,8 @@ namespace {
 #undef MAPPER
 }
 
-FFMS_AudioSource::FFMS_AudioSource(const char *SourceFile, FFMS_Index &Index, int Track, int DelayMode, int FillGaps, double DrcScale)
-    : DrcScale(DrcScale), LastValidTS(AV_NOPTS_VALUE), SourceFile(SourceFile), ResampleContext{ swr_alloc() }, TrackNumber(Track) {
+FFMS_AudioSource::FFMS_AudioSource(const char *SourceFile, FFMS_Index &Index, int Track, int DelayMode, int FillGaps, double DrcScale, const std::shared_ptr<InputReader> &Reader)
+    : DrcScale(DrcScale), LastValidTS(AV_NOPTS_VALUE), SourceFile(SourceFile), Reader(Reader), ResampleContext{ swr_alloc() }, TrackNumber(Track) {
     try {
         if (FillGaps < -1 || FillGaps > 1)
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_INVALID_ARGUMENT,
@@ -72,7 +74,10 @@ FFMS_AudioSource::FFMS_AudioSource(const char *SourceFile, FFMS_Index &Index, in
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_INVALID_ARGUMENT,
                 "Audio track contains no audio frames");
 
-        if (!Index.CompareFileSignature(SourceFile))
+        if (!this->Reader)
+            this->Reader = OpenFileReader(SourceFile, AccessPattern::NORMAL);
+
+        if (!Index.CompareFileSignature(SourceFile, this->Reader))
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_FILE_MISMATCH,
                 "The index does not match the source file");
 
@@ -265,6 +270,7 @@ void FFMS_AudioSource::ResampleAndCache(CacheIterator pos) {
 
     uint8_t *OutPlanes[1] = { dst };
 
+    ScopedStatTimer Timer(Stats.ResampleTime);
     swr_convert(ResampleContext.get(), OutPlanes, DecodeFrame->nb_samples, (const uint8_t **)DecodeFrame->extended_data, DecodeFrame->nb_samples);
 }
 
@@ -297,10 +303,33 @@ FFMS_AudioSource::AudioBlock *FFMS_AudioSource::CacheBlock(CacheIterator &pos) {
         if (min == pos) ++pos;
         Cache.erase(min);
     }
+    UpdateCacheMemory();
     return &*block;
 }
 
+void FFMS_AudioSource::UpdateCacheMemory() {
+    int64_t Size = 0;
+    for (const auto &Block : Cache)
+        Size += Block.DataSize;
+    CacheMemory.Set(Size);
+}
+
+void FFMS_AudioSource::TrimCache() {
+    MemoryGovernor &Governor = MemoryGovernor::Instance();
+    auto first = CacheNoDelete;
+    ++first;
+    while (first != Cache.end() && Governor.OverLimit()) {
+        auto min = first;
+        for (auto it = first; it != Cache.end(); ++it)
+            if (it->Age < min->Age) min = it;
+        if (min == first) ++first;
+        CacheMemory.Set(CacheMemory.Get() - min->DataSize);
+        Cache.erase(min);
+    }
+}
+
 int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
+    TraceSpan Span("audio", "DecodePacket", PacketNumber);
     SmartAVPacket Packet;
 
     if (!ReadPacket(*Packet)) {
@@ -311,16 +340,24 @@ int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
     CurrentFrame = &Frames[PacketNumber];
     CurrentSample = CurrentFrame->SampleStart;
 
-    // Value code intentionally ignored, combined with the checks when indexing this mostly gives the expected behavior
-    avcodec_send_packet(CodecContext, Packet.get());
+    {
+        ScopedStatTimer Timer(Stats.DecodeTime);
+        // Value code intentionally ignored, combined with the checks when indexing this mostly gives the expected behavior
+        avcodec_send_packet(CodecContext, Packet.get());
+    }
 
     int NumberOfSamples = 0;
     AudioBlock *CachedBlock = nullptr;
 
     while (true) {
         av_frame_unref(DecodeFrame);
-        int Ret = avcodec_receive_frame(CodecContext, DecodeFrame);
+        int Ret;
+        {
+            ScopedStatTimer Timer(Stats.DecodeTime);
+            Ret = avcodec_receive_frame(CodecContext, DecodeFrame);
+        }
         if (Ret == 0) {
+            ++Stats.FramesDecoded;
             NumberOfSamples += DecodeFrame->nb_samples;
             if (DecodeFrame->nb_samples > 0) {
                 if (pos)
@@ -332,6 +369,7 @@ int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
                 throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_UNKNOWN,
                     "ReadPacket unexpectedly failed to read a packet");
             }
+            ScopedStatTimer Timer(Stats.DecodeTime);
             avcodec_send_packet(CodecContext, Packet.get());
         } else if (Ret == AVERROR_EOF) {
             break;
@@ -361,6 +399,7 @@ int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
         auto ptr = CachedBlock->Grow(MissingBytes);
         memcpy(ptr, ptr - MissingBytes, MissingBytes);
     }
+    UpdateCacheMemory();
     return NumberOfSamples;
 }
 
@@ -369,11 +408,13 @@ static bool SampleStartComp(const FrameInfo &a, const FrameInfo &b) {
 }
 
 void FFMS_AudioSource::GetAudio(void *Buf, int64_t Start, int64_t Count) {
+    TraceSpan Span("audio", "GetAudio", Start);
     if (Start < 0 || Start + Count > AP.NumSamples || Count < 0)
         throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
             "Out of bounds audio samples requested");
 
     CacheBeginning();
+    TrimCache();
 
     uint8_t *Dst = static_cast<uint8_t*>(Buf);
 
@@ -405,6 +446,7 @@ void FFMS_AudioSource::GetAudio(void *Buf, int64_t Start, int64_t Count) {
             size_t Bytes = static_cast<size_t>(CopySamples * BytesPerSample);
 
             memcpy(Dst + DstOffset * BytesPerSample, it->Data.get() + SrcOffset * BytesPerSample, Bytes);
+            ++Stats.CacheHits;
             Start += CopySamples;
             Count -= CopySamples;
             Dst += Bytes;
@@ -412,6 +454,7 @@ void FFMS_AudioSource::GetAudio(void *Buf, int64_t Start, int64_t Count) {
         }
         // Decode another block
         else {
+            ++Stats.CacheMisses;
             if (Start < CurrentSample && SeekOffset == -1)
                 throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_CODEC, "Audio stream is not seekable");
 
@@ -488,9 +531,9 @@ size_t FFMS_AudioSource::GetSeekablePacketNumber(FFMS_Track const& Frames, size_
 
 void FFMS_AudioSource::OpenFile() {
     avcodec_free_context(&CodecContext);
-    avformat_close_input(&FormatContext);
 
-    LAVFOpenFile(SourceFile.c_str(), FormatContext, TrackNumber, LAVFOpts);
+    Demuxer.Open(SourceFile, Reader, TrackNumber, LAVFOpts, DemuxerSharing);
+    FormatContext = Demuxer.GetFormatContext();
 
     auto *Codec = avcodec_find_decoder(FormatContext->streams[TrackNumber]->codecpar->codec_id);
     if (Codec == nullptr)
@@ -520,7 +563,8 @@ void FFMS_AudioSource::OpenFile() {
 void FFMS_AudioSource::Free() {
     av_frame_free(&DecodeFrame);
     avcodec_free_context(&CodecContext);
-    avformat_close_input(&FormatContext);
+    Demuxer.Close();
+    FormatContext = nullptr;
 }
 
 FFMS_AudioSource::~FFMS_AudioSource() {
@@ -532,13 +576,15 @@ int64_t FFMS_AudioSource::FrameTS(size_t Packet) const {
 }
 
 void FFMS_AudioSource::Seek() {
+    TraceSpan Span("audio", "Seek", PacketNumber);
     size_t TargetPacket = GetSeekablePacketNumber(Frames, PacketNumber);
     LastValidTS = AV_NOPTS_VALUE;
+    ++Stats.Seeks;
 
     int Flags = Frames.HasTS ? AVSEEK_FLAG_BACKWARD : AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_BYTE;
 
-    if (av_seek_frame(FormatContext, TrackNumber, FrameTS(TargetPacket), Flags) < 0)
-        av_seek_frame(FormatContext, TrackNumber, FrameTS(TargetPacket), Flags | AVSEEK_FLAG_ANY);
+    if (Demuxer.Seek(FrameTS(TargetPacket), Flags) < 0)
+        Demuxer.Seek(FrameTS(TargetPacket), Flags | AVSEEK_FLAG_ANY);
 
     if (TargetPacket != PacketNumber) {
         // Decode until the PTS changes so we know where we are
@@ -548,7 +594,11 @@ void FFMS_AudioSource::Seek() {
 }
 
 bool FFMS_AudioSource::ReadPacket(AVPacket &Packet) {
-    while (av_read_frame(FormatContext, &Packet) >= 0) {
+    TraceSpan Span("audio", "ReadPacket");
+    ScopedStatTimer Timer(Stats.DemuxTime);
+    while (Demuxer.Read(&Packet) >= 0) {
+        ++Stats.PacketsRead;
+        Stats.BytesRead += Packet.size;
         if (Packet.stream_index == TrackNumber) {
             // Required because not all audio packets, especially in ogg, have a pts. Use the previous valid packet's pts instead.
             if (Packet.pts == AV_NOPTS_VALUE)
@@ -569,3 +619,20 @@ bool FFMS_AudioSource::ReadPacket(AVPacket &Packet) {
     return false;
 }
 
+void FFMS_AudioSource::GetStats(FFMS_AudioSourceStats &Out) const {
+    Out = {};
+    Out.Seeks = Stats.Seeks;
+    Out.PacketsRead = Stats.PacketsRead;
+    Out.BytesRead = Stats.BytesRead;
+    Out.FramesDecoded = Stats.FramesDecoded;
+    Out.CacheHits = Stats.CacheHits;
+    Out.CacheMisses = Stats.CacheMisses;
+    Out.CacheMemory = CacheMemory.Get();
+    Out.DemuxTime = StatSeconds(Stats.DemuxTime);
+    Out.DecodeTime = StatSeconds(Stats.DecodeTime);
+    Out.ResampleTime = StatSeconds(Stats.ResampleTime);
+}
+
+void FFMS_AudioSource::SetReadAhead(int BufferSize, int Depth) {
+    ::SetReadAhead(Reader.get(), BufferSize, Depth);
+}
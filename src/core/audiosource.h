@@ -21,6 +21,8 @@
 #ifndef FFAUDIOSOURCE_H
 #define FFAUDIOSOURCE_H
 
+#include "demuxer.h"
+#include "memorygovernor.h"
 #include "utils.h"
 #include "track.h"
 
@@ -61,11 +63,27 @@ struct FFMS_AudioSource {
     };
     typedef std::list<AudioBlock>::iterator CacheIterator;
 
+    // Running totals behind FFMS_AudioSourceStats, times are in nanoseconds
+    struct Counters {
+        StatCounter Seeks{0};
+        StatCounter PacketsRead{0};
+        StatCounter BytesRead{0};
+        StatCounter FramesDecoded{0};
+        StatCounter CacheHits{0};
+        StatCounter CacheMisses{0};
+        StatCounter DemuxTime{0};
+        StatCounter DecodeTime{0};
+        StatCounter ResampleTime{0};
+    } Stats;
+
+    DemuxHandle Demuxer;
+    // Owned by Demuxer
     AVFormatContext *FormatContext = nullptr;
     std::map<std::string, std::string> LAVFOpts;
     double DrcScale;
     int64_t LastValidTS;
     std::string SourceFile;
+    std::shared_ptr<InputReader> Reader;
 
     // delay in samples to apply to the audio
     int64_t Delay = 0;
@@ -75,6 +93,8 @@ struct FFMS_AudioSource {
     size_t MaxCacheBlocks = 50;
     // pointer to last element of the cache which should never be deleted
     CacheIterator CacheNoDelete;
+    // total size of the decoded audio in the cache
+    MemoryCharge CacheMemory{ MemoryGovernor::AUDIO_CACHE };
     // bytes per sample * number of channels, *after* resampling if applicable
     size_t BytesPerSample = 0;
 
@@ -98,6 +118,10 @@ struct FFMS_AudioSource {
     // Cache the unseekable beginning of the file once the output format is set
     void CacheBeginning();
 
+    void UpdateCacheMemory();
+    // Drop the oldest blocks after CacheNoDelete while all sources together use too much memory
+    void TrimCache();
+
     // Called after seeking
     void Seek();
     // Read the next packet from the file
@@ -135,7 +159,7 @@ struct FFMS_AudioSource {
 
     void Free();
 public:
-    FFMS_AudioSource(const char *SourceFile, FFMS_Index &Index, int Track, int DelayMode, int FillGaps, double DrcScale);
+    FFMS_AudioSource(const char *SourceFile, FFMS_Index &Index, int Track, int DelayMode, int FillGaps, double DrcScale, const std::shared_ptr<InputReader> &Reader = nullptr);
     ~FFMS_AudioSource();
     FFMS_Track *GetTrack() { return &Frames; }
     const FFMS_AudioProperties& GetAudioProperties() const { return AP; }
@@ -143,6 +167,8 @@ public:
 
     std::unique_ptr<FFMS_ResampleOptions> CreateResampleOptions() const;
     void SetOutputFormat(FFMS_ResampleOptions const& opt);
+    void GetStats(FFMS_AudioSourceStats &Out) const;
+    void SetReadAhead(int BufferSize, int Depth);
 
     static size_t GetSeekablePacketNumber(FFMS_Track const& Frames, size_t PacketNumber);
 };
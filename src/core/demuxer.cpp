@@ -0,0 +1,362 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "demuxer.h"
+
+#include "inputreader.h"
+#include "memorygovernor.h"
+#include "utils.h"
+
+#include <deque>
+#include <mutex>
+
+thread_local bool DemuxerSharing = false;
+
+namespace {
+// How much of what was read is kept around for sources lagging behind and seeks within recent packets
+constexpr size_t SharedLogSize = 32 * 1024 * 1024;
+
+int64_t PacketTimestamp(const AVPacket *Packet) {
+    return Packet->pts != AV_NOPTS_VALUE ? Packet->pts : Packet->dts;
+}
+}
+
+// A single format context for all audio and video streams of a file, read by any number of handles.
+// Every packet read is appended to a log that each handle walks with its own cursor, so sources moving
+// through the file together only read it once.
+class SharedDemuxer {
+    std::mutex Mutex;
+    AVFormatContext *FormatContext = nullptr;
+    std::deque<AVPacket *> Log;
+    // Sequence number of Log.front()
+    int64_t LogStart = 0;
+    size_t LogBytes = 0;
+    MemoryCharge LogMemory{ MemoryGovernor::DEMUXER };
+    // Nothing has been dropped from the log since the file was opened
+    bool LogFromStart = true;
+    // Set once av_read_frame fails, the error every handle at the end of the log gets
+    int EndError = 0;
+    int Handles = 0;
+
+    void ClearLog() {
+        for (auto Packet : Log)
+            av_packet_free(&Packet);
+        LogStart += Log.size();
+        Log.clear();
+        LogBytes = 0;
+        LogMemory.Set(0);
+    }
+
+public:
+    enum ReadResult {
+        PACKET,
+        END,
+        BEHIND
+    };
+
+    SharedDemuxer(const std::string &SourceFile, const std::shared_ptr<InputReader> &Reader, const std::map<std::string, std::string> &LAVFOpts) {
+        LAVFOpenFile(SourceFile.c_str(), FormatContext, -1, LAVFOpts, Reader);
+        for (unsigned i = 0; i < FormatContext->nb_streams; i++) {
+            AVMediaType Type = FormatContext->streams[i]->codecpar->codec_type;
+            if (Type == AVMEDIA_TYPE_VIDEO || Type == AVMEDIA_TYPE_AUDIO)
+                FormatContext->streams[i]->discard = AVDISCARD_DEFAULT;
+        }
+    }
+
+    ~SharedDemuxer() {
+        ClearLog();
+        CloseFormatContext(FormatContext);
+    }
+
+    static std::shared_ptr<SharedDemuxer> Get(const std::string &SourceFile, const std::shared_ptr<InputReader> &Reader, const std::map<std::string, std::string> &LAVFOpts) {
+        static std::mutex RegistryMutex;
+        static std::map<std::string, std::weak_ptr<SharedDemuxer>> Registry;
+
+        std::string Key = SourceFile;
+        if (Reader && !Reader->Key().empty())
+            Key += "\n" + Reader->Key();
+        for (const auto &Opt : LAVFOpts)
+            Key += "\n" + Opt.first + "=" + Opt.second;
+
+        std::lock_guard<std::mutex> Lock(RegistryMutex);
+        for (auto Iter = Registry.begin(); Iter != Registry.end();) {
+            if (Iter->second.expired())
+                Iter = Registry.erase(Iter);
+            else
+                ++Iter;
+        }
+        std::shared_ptr<SharedDemuxer> Demuxer = Registry[Key].lock();
+        if (!Demuxer) {
+            Demuxer = std::make_shared<SharedDemuxer>(SourceFile, Reader, LAVFOpts);
+            Registry[Key] = Demuxer;
+        }
+        return Demuxer;
+    }
+
+    AVFormatContext *GetFormatContext() const {
+        return FormatContext;
+    }
+
+    // A new handle starts at the beginning of the file, which is only possible while that's still in the log
+    bool Attach(int64_t &Cursor) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (!LogFromStart)
+            return false;
+        Cursor = LogStart;
+        ++Handles;
+        return true;
+    }
+
+    void Detach() {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        --Handles;
+    }
+
+    // Copies the next packet of Track at or after Cursor, reading more from the file when the cursor is at the end of the log
+    ReadResult Read(int Track, int64_t &Cursor, AVPacket *Packet, int &Error) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        while (true) {
+            if (Cursor < LogStart)
+                return BEHIND;
+
+            if (Cursor < LogStart + static_cast<int64_t>(Log.size())) {
+                const AVPacket *Entry = Log[Cursor - LogStart];
+                ++Cursor;
+                if (Entry->stream_index != Track)
+                    continue;
+                Error = av_packet_ref(Packet, Entry);
+                return Error < 0 ? END : PACKET;
+            }
+
+            if (EndError < 0) {
+                Error = EndError;
+                return END;
+            }
+
+            AVPacket *Next = av_packet_alloc();
+            if (!Next) {
+                Error = AVERROR(ENOMEM);
+                return END;
+            }
+            int Ret = av_read_frame(FormatContext, Next);
+            if (Ret < 0) {
+                av_packet_free(&Next);
+                // Transient errors shouldn't stick for everyone
+                if (!IsIOError(Ret))
+                    EndError = Ret;
+                Error = Ret;
+                return END;
+            }
+
+            Log.push_back(Next);
+            LogBytes += Next->size;
+            // Over the memory limit handles that fall behind go their own way sooner
+            while ((LogBytes > SharedLogSize || MemoryGovernor::Instance().OverLimit()) && Log.size() > 1) {
+                LogBytes -= Log.front()->size;
+                av_packet_free(&Log.front());
+                Log.pop_front();
+                ++LogStart;
+                LogFromStart = false;
+                LogMemory.Set(LogBytes);
+            }
+            LogMemory.Set(LogBytes);
+        }
+    }
+
+    // Finds where av_seek_frame would end up using only the logged packets, which requires the log
+    // to cover the target and some of what comes after it
+    bool FindSeekPoint(int Track, int64_t Timestamp, int Flags, int64_t &Cursor) {
+        // Where a forward timestamp seek ends up is up to the demuxer
+        if (!(Flags & (AVSEEK_FLAG_BYTE | AVSEEK_FLAG_BACKWARD)))
+            return false;
+
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (Flags & AVSEEK_FLAG_BYTE) {
+            bool Covered = LogFromStart;
+            for (size_t i = 0; i < Log.size(); i++) {
+                if (Log[i]->pos < 0)
+                    continue;
+                if (Log[i]->pos < Timestamp) {
+                    Covered = true;
+                } else if (Covered) {
+                    Cursor = LogStart + i;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+            if (Covered && EndError < 0) {
+                Cursor = LogStart + Log.size();
+                return true;
+            }
+            return false;
+        }
+
+        int64_t Found = -1;
+        bool Beyond = EndError < 0;
+        for (size_t i = 0; i < Log.size(); i++) {
+            const AVPacket *Entry = Log[i];
+            int64_t TS = PacketTimestamp(Entry);
+            if (Entry->stream_index != Track || TS == AV_NOPTS_VALUE)
+                continue;
+            if (TS <= Timestamp) {
+                if ((Flags & AVSEEK_FLAG_ANY) || (Entry->flags & AV_PKT_FLAG_KEY))
+                    Found = i;
+            } else if (Entry->dts == AV_NOPTS_VALUE || Entry->dts > Timestamp) {
+                Beyond = true;
+            }
+        }
+        if (!Beyond)
+            return false;
+        if (Found >= 0) {
+            Cursor = LogStart + Found;
+            return true;
+        }
+        if (LogFromStart) {
+            Cursor = LogStart;
+            return true;
+        }
+        return false;
+    }
+
+    // Only a handle that has the demuxer to itself may move it
+    bool SeekAlone(int Track, int64_t Timestamp, int Flags, int64_t &Cursor, int &Ret) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (Handles > 1)
+            return false;
+        Ret = av_seek_frame(FormatContext, Track, Timestamp, Flags);
+        if (Ret >= 0) {
+            ClearLog();
+            LogFromStart = false;
+            EndError = 0;
+            Cursor = LogStart;
+        }
+        return true;
+    }
+};
+
+DemuxHandle::~DemuxHandle() {
+    Close();
+}
+
+void DemuxHandle::Open(const std::string &SourceFile, const std::shared_ptr<InputReader> &Reader, int Track, const std::map<std::string, std::string> &LAVFOpts, bool AllowSharing) {
+    Close();
+    this->SourceFile = SourceFile;
+    this->Reader = Reader;
+    this->LAVFOpts = LAVFOpts;
+    this->Track = Track;
+    HaveLastPacket = false;
+    HaveLastSeek = false;
+
+    if (AllowSharing) {
+        Shared = SharedDemuxer::Get(SourceFile, Reader, LAVFOpts);
+        if (Shared->Attach(Cursor))
+            return;
+        Shared.reset();
+    }
+    LAVFOpenFile(SourceFile.c_str(), Private, Track, LAVFOpts, Reader);
+}
+
+void DemuxHandle::Close() {
+    if (Shared && !Private)
+        Shared->Detach();
+    Shared.reset();
+    CloseFormatContext(Private);
+}
+
+AVFormatContext *DemuxHandle::GetFormatContext() const {
+    return Shared ? Shared->GetFormatContext() : Private;
+}
+
+void DemuxHandle::Remember(const AVPacket *Packet) {
+    HaveLastPacket = true;
+    LastPTS = Packet->pts;
+    LastDTS = Packet->dts;
+    LastPos = Packet->pos;
+}
+
+// Continues exactly where the shared reading left off, by repeating the last seek or seeking
+// to the last packet returned and skipping everything up to and including it
+void DemuxHandle::GoPrivate() {
+    LAVFOpenFile(SourceFile.c_str(), Private, Track, LAVFOpts, Reader);
+    // Stays attached for the stream information but no longer holds the shared position back
+    Shared->Detach();
+
+    if (!HaveLastPacket) {
+        if (HaveLastSeek)
+            av_seek_frame(Private, Track, LastSeekTimestamp, LastSeekFlags);
+        return;
+    }
+
+    int64_t Target = LastPTS != AV_NOPTS_VALUE ? LastPTS : LastDTS;
+    int Ret = -1;
+    if (Target != AV_NOPTS_VALUE)
+        Ret = av_seek_frame(Private, Track, Target, AVSEEK_FLAG_BACKWARD);
+    if (Ret < 0 && LastPos >= 0)
+        av_seek_frame(Private, Track, LastPos, AVSEEK_FLAG_BYTE | AVSEEK_FLAG_BACKWARD);
+
+    SmartAVPacket Packet;
+    while (av_read_frame(Private, Packet.get()) >= 0) {
+        bool Match = LastPos >= 0 ? Packet->pos == LastPos : (Packet->pts == LastPTS && Packet->dts == LastDTS);
+        av_packet_unref(Packet.get());
+        if (Match)
+            return;
+    }
+    throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+        "Couldn't find the current position in '" + SourceFile + "' again");
+}
+
+int DemuxHandle::Read(AVPacket *Packet) {
+    if (Shared && !Private) {
+        int Error = 0;
+        SharedDemuxer::ReadResult Result = Shared->Read(Track, Cursor, Packet, Error);
+        if (Result == SharedDemuxer::PACKET) {
+            Remember(Packet);
+            return 0;
+        }
+        if (Result == SharedDemuxer::END)
+            return Error;
+        GoPrivate();
+    }
+
+    int Ret = av_read_frame(Private, Packet);
+    if (Ret >= 0)
+        Remember(Packet);
+    return Ret;
+}
+
+int DemuxHandle::Seek(int64_t Timestamp, int Flags) {
+    HaveLastPacket = false;
+    HaveLastSeek = true;
+    LastSeekTimestamp = Timestamp;
+    LastSeekFlags = Flags;
+
+    if (Shared && !Private) {
+        if (Shared->FindSeekPoint(Track, Timestamp, Flags, Cursor))
+            return 0;
+        int Ret;
+        if (Shared->SeekAlone(Track, Timestamp, Flags, Cursor, Ret))
+            return Ret;
+        // Somebody else is reading elsewhere in the file so go our own way
+        LAVFOpenFile(SourceFile.c_str(), Private, Track, LAVFOpts, Reader);
+        Shared->Detach();
+    }
+    return av_seek_frame(Private, Track, Timestamp, Flags);
+}
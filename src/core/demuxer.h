@@ -0,0 +1,82 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef DEMUXER_H
+#define DEMUXER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+struct AVFormatContext;
+struct AVPacket;
+class InputReader;
+class SharedDemuxer;
+
+// Whether sources opened by this thread read through a demuxer shared with other sources of the same file.
+// Per thread so that turning it on around creating the sources meant to share doesn't affect anyone else.
+extern thread_local bool DemuxerSharing;
+
+// What a source reads its packets through. Either it owns a format context of its own, the same as
+// what LAVFOpenFile gives, or it has a cursor into the packets read by a SharedDemuxer for the file.
+// A shared handle keeps the exact behavior of a private one: when it can't be served from the
+// shared packets anymore it opens a private context and picks up right after the last packet it got.
+class DemuxHandle {
+    std::shared_ptr<SharedDemuxer> Shared;
+    AVFormatContext *Private = nullptr;
+    std::string SourceFile;
+    std::shared_ptr<InputReader> Reader;
+    std::map<std::string, std::string> LAVFOpts;
+    int Track = -1;
+
+    // Sequence number of the next shared packet to look at
+    int64_t Cursor = 0;
+    // Where the handle is, for continuing in a private context
+    bool HaveLastPacket = false;
+    int64_t LastPTS = 0;
+    int64_t LastDTS = 0;
+    int64_t LastPos = -1;
+    bool HaveLastSeek = false;
+    int64_t LastSeekTimestamp = 0;
+    int LastSeekFlags = 0;
+
+    void GoPrivate();
+    void Remember(const AVPacket *Packet);
+
+public:
+    DemuxHandle() = default;
+    DemuxHandle(const DemuxHandle &) = delete;
+    DemuxHandle &operator=(const DemuxHandle &) = delete;
+    ~DemuxHandle();
+
+    // Opens the file positioned at its start, closing whatever was open before
+    void Open(const std::string &SourceFile, const std::shared_ptr<InputReader> &Reader, int Track, const std::map<std::string, std::string> &LAVFOpts, bool AllowSharing);
+    void Close();
+    // Stream information, always from the same context for as long as the handle stays open
+    AVFormatContext *GetFormatContext() const;
+    bool IsShared() const { return Shared && !Private; }
+
+    // Same as av_read_frame and av_seek_frame, only ever returns packets of Track
+    int Read(AVPacket *Packet);
+    int Seek(int64_t Timestamp, int Flags);
+};
+
+#endif
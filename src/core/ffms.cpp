@@ -21,7 +21,11 @@
 #include "ffms.h"
 
 #include "audiosource.h"
+#include "demuxer.h"
 #include "indexing.h"
+#include "inputreader.h"
+#include "memorygovernor.h"
+#include "trace.h"
 #include "videosource.h"
 #include "videoutils.h"
 
@@ -30,6 +34,7 @@ extern "C" {
 #include <libavutil/pixdesc.h>
 }
 
+#include <cstdlib>
 #include <mutex>
 #include <sstream>
 #include <iomanip>
@@ -84,6 +89,14 @@ FFMS_API(void) FFMS_Init(int, int) {
 #else
         av_log_set_level(AV_LOG_QUIET);
 #endif
+        // Lets tracing be turned on for applications that don't know about it
+        const char *TraceFile = getenv("FFMS_TRACE");
+        if (TraceFile && *TraceFile) {
+            try {
+                SetTraceFile(TraceFile);
+            } catch (FFMS_Exception &) {
+            }
+        }
     });
 }
 
@@ -99,9 +112,58 @@ FFMS_API(void) FFMS_SetLogLevel(int Level) {
     av_log_set_level(Level);
 }
 
+FFMS_API(int) FFMS_SetTraceFile(const char *Filename, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        SetTraceFile(Filename);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetMemoryLimit(int64_t Bytes, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        if (Bytes < 0)
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+                "Memory limit can't be negative");
+        MemoryGovernor::Instance().SetLimit(Bytes);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(void) FFMS_GetMemoryUsage(FFMS_MemoryUsage *Usage) {
+    MemoryGovernor::Instance().GetUsage(*Usage);
+}
+
+FFMS_API(void) FFMS_SetDemuxerSharing(int Enable) {
+    DemuxerSharing = !!Enable;
+}
+
+FFMS_API(void) FFMS_SetMemoryMappedInput(int Enable) {
+    MemoryMappedInput = !!Enable;
+}
+
+FFMS_API(int) FFMS_SetReadAhead(int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        DefaultReadAhead.Set(BufferSize, Depth);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
 FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSource(const char *SourceFile, int Track, FFMS_Index *Index, int Threads, int SeekMode, FFMS_ErrorInfo *ErrorInfo) {
+    return FFMS_CreateVideoSource2(SourceFile, Track, Index, Threads, SeekMode, FFMS_VIEWS_ALL, ErrorInfo);
+}
+
+FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSource2(const char *SourceFile, int Track, FFMS_Index *Index, int Threads, int SeekMode, int Views, FFMS_ErrorInfo *ErrorInfo) {
     try {
-        return new FFMS_VideoSource(SourceFile, *Index, Track, Threads, SeekMode);
+        return new FFMS_VideoSource(SourceFile, *Index, Track, Threads, SeekMode, Views);
     } catch (FFMS_Exception &e) {
         e.CopyOut(ErrorInfo);
         return nullptr;
@@ -121,6 +183,24 @@ FFMS_API(FFMS_AudioSource *) FFMS_CreateAudioSource2(const char *SourceFile, int
     }
 }
 
+FFMS_API(FFMS_VideoSource *) FFMS_CreateVideoSourceFromInput(const char *Name, const FFMS_Input *Input, int Track, FFMS_Index *Index, int Threads, int SeekMode, int Views, FFMS_ErrorInfo *ErrorInfo) {
+    try {
+        return new FFMS_VideoSource(Name, *Index, Track, Threads, SeekMode, Views, std::make_shared<UserInputReader>(Name, Input));
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
+FFMS_API(FFMS_AudioSource *) FFMS_CreateAudioSourceFromInput(const char *Name, const FFMS_Input *Input, int Track, FFMS_Index *Index, int DelayMode, int FillGaps, double DrcScale, FFMS_ErrorInfo *ErrorInfo) {
+    try {
+        return new FFMS_AudioSource(Name, *Index, Track, DelayMode, FillGaps, DrcScale, std::make_shared<UserInputReader>(Name, Input));
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
 FFMS_API(void) FFMS_DestroyVideoSource(FFMS_VideoSource *V) {
     delete V;
 }
@@ -147,6 +227,83 @@ FFMS_API(const FFMS_Frame *) FFMS_GetFrame(FFMS_VideoSource *V, int n, FFMS_Erro
     }
 }
 
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameInto(FFMS_VideoSource *V, int n, uint8_t * const *DstData, const int *DstLinesize, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        return V->GetFrameInto(n, DstData, DstLinesize);
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameByTimeInto(FFMS_VideoSource *V, double Time, uint8_t * const *DstData, const int *DstLinesize, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        return V->GetFrameByTimeInto(Time, DstData, DstLinesize);
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
+FFMS_API(const FFMS_Frame *) FFMS_GetFrameRef(FFMS_VideoSource *V, int n, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        return V->GetFrameRef(n);
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
+FFMS_API(void) FFMS_ReleaseFrame(const FFMS_Frame *Frame) {
+    ReleaseFrameRef(Frame);
+}
+
+FFMS_API(int) FFMS_GetFrames(FFMS_VideoSource *V, int First, int Last, int Step, TFrameCallback Callback, void *Private, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->GetFrames(First, Last, Step, Callback, Private);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(const FFMS_Frame *) FFMS_GetNearestKeyFrame(FFMS_VideoSource *V, int n, int *KeyFrameNumber, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        return V->GetNearestKeyFrame(n, KeyFrameNumber);
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
+FFMS_API(int) FFMS_GetPacket(FFMS_VideoSource *V, int n, const uint8_t **Data, int *Size, FFMS_PacketInfo *Info, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        const AVPacket *Packet = V->GetPacket(n);
+        *Data = Packet->data;
+        *Size = Packet->size;
+        if (Info) {
+            Info->PTS = Packet->pts;
+            Info->DTS = Packet->dts;
+            Info->Duration = Packet->duration;
+            Info->FilePos = Packet->pos;
+            Info->KeyFrame = !!(Packet->flags & AV_PKT_FLAG_KEY);
+        }
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(void) FFMS_GetVideoExtradata(FFMS_VideoSource *V, const uint8_t **Data, int *Size) {
+    V->GetExtradata(*Data, *Size);
+}
+
 FFMS_API(const FFMS_Frame *) FFMS_GetFrameByTime(FFMS_VideoSource *V, double Time, FFMS_ErrorInfo *ErrorInfo) {
     ClearErrorInfo(ErrorInfo);
     try {
@@ -195,6 +352,118 @@ FFMS_API(void) FFMS_ResetInputFormatV(FFMS_VideoSource *V) {
     V->ResetInputFormat();
 }
 
+FFMS_API(int) FFMS_SetVideoCacheSize(FFMS_VideoSource *V, int64_t MaxSize, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetCacheSize(MaxSize);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoPacketCacheSize(FFMS_VideoSource *V, int64_t MaxSize, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetPacketCacheSize(MaxSize);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoReadAhead(FFMS_VideoSource *V, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetReadAhead(BufferSize, Depth);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoDecoderPoolSize(FFMS_VideoSource *V, int NumDecoders, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetDecoderPoolSize(NumDecoders);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoPrefetch(FFMS_VideoSource *V, int NumFrames, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetPrefetchSize(NumFrames);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoConversionThreads(FFMS_VideoSource *V, int Threads, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetConversionThreads(Threads);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoFrameMetadata(FFMS_VideoSource *V, int Mask, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetFrameMetadata(Mask);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoDecodeProfile(FFMS_VideoSource *V, int Profile, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetDecodeProfile(Profile);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetVideoThreadingMode(FFMS_VideoSource *V, int Mode, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetThreadingMode(Mode);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(void) FFMS_GetVideoSeekCosts(FFMS_VideoSource *V, double *FrameTime, double *SeekTime) {
+    V->GetSeekCosts(*FrameTime, *SeekTime);
+}
+
+FFMS_API(void) FFMS_GetVideoSourceStats(FFMS_VideoSource *V, FFMS_VideoSourceStats *Stats) {
+    V->GetStats(*Stats);
+}
+
+FFMS_API(void) FFMS_GetAudioSourceStats(FFMS_AudioSource *A, FFMS_AudioSourceStats *Stats) {
+    A->GetStats(*Stats);
+}
+
+FFMS_API(int) FFMS_SetAudioReadAhead(FFMS_AudioSource *A, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        A->SetReadAhead(BufferSize, Depth);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
 FFMS_API(FFMS_ResampleOptions *) FFMS_CreateResampleOptions(FFMS_AudioSource *A) {
     return A->CreateResampleOptions().release();
 }
@@ -322,6 +591,16 @@ FFMS_API(FFMS_Indexer *) FFMS_CreateIndexer2(const char *SourceFile, const FFMS_
     }
 }
 
+FFMS_API(FFMS_Indexer *) FFMS_CreateIndexerFromInput(const char *Name, const FFMS_Input *Input, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        return new FFMS_Indexer(Name, DemuxerOptions, NumOptions, std::make_shared<UserInputReader>(Name, Input));
+    } catch (FFMS_Exception &e) {
+        e.CopyOut(ErrorInfo);
+        return nullptr;
+    }
+}
+
 FFMS_API(FFMS_Index *) FFMS_DoIndexing2(FFMS_Indexer *Indexer, int ErrorHandling, FFMS_ErrorInfo *ErrorInfo) {
     ClearErrorInfo(ErrorInfo);
 
@@ -349,6 +628,20 @@ FFMS_API(void) FFMS_SetProgressCallback(FFMS_Indexer *Indexer, TIndexCallback IC
     Indexer->SetProgressCallback(IC, ICPrivate);
 }
 
+FFMS_API(void) FFMS_SetSeekPointVerification(FFMS_Indexer *Indexer, int Verify) {
+    Indexer->SetVerifySeekPoints(!!Verify);
+}
+
+FFMS_API(int) FFMS_SetIndexerReadAhead(FFMS_Indexer *Indexer, int BufferSize, int Depth, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        Indexer->SetReadAhead(BufferSize, Depth);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
 FFMS_API(void) FFMS_CancelIndexing(FFMS_Indexer *Indexer) {
     delete Indexer;
 }
@@ -20,6 +20,8 @@
 
 #include "indexing.h"
 
+#include "inputreader.h"
+#include "trace.h"
 #include "track.h"
 #include "videoutils.h"
 #include "zipfile.h"
@@ -35,7 +37,7 @@ extern "C" {
 }
 
 #define INDEXID 0x53920873
-#define INDEX_VERSION 8
+#define INDEX_VERSION 9
 
 SharedAVContext::~SharedAVContext() {
     avcodec_free_context(&CodecContext);
@@ -43,21 +45,44 @@ SharedAVContext::~SharedAVContext() {
         av_parser_close(Parser);
 }
 
-void FFMS_Index::CalculateFileSignature(const char *Filename, int64_t *Filesize, uint8_t Digest[20]) {
-    FileHandle file(Filename, "rb", FFMS_ERROR_INDEX, FFMS_ERROR_FILE_READ);
+void FFMS_Index::CalculateFileSignature(const char *Filename, const std::shared_ptr<InputReader> &Reader, int64_t *Filesize, uint8_t Digest[20]) {
+    std::unique_ptr<FileHandle> file;
+    if (!Reader)
+        file.reset(new FileHandle(Filename, "rb", FFMS_ERROR_INDEX, FFMS_ERROR_FILE_READ));
+
+    // Reads the whole block unless the end is reached first, the same way for both kinds of input
+    auto ReadAt = [&](int64_t Offset, char *Buffer, size_t Size) -> size_t {
+        if (!Reader) {
+            file->Seek(Offset, SEEK_SET);
+            return file->Read(Buffer, Size);
+        }
+        size_t Total = 0;
+        while (Total < Size) {
+            int Ret = Reader->Read(Offset + Total, reinterpret_cast<uint8_t *>(Buffer + Total), static_cast<int>(Size - Total));
+            if (Ret < 0)
+                throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_FILE_READ,
+                    std::string("Failed to read from '") + Filename + "'");
+            if (Ret == 0)
+                break;
+            Total += Ret;
+        }
+        return Total;
+    };
 
     std::unique_ptr<AVSHA, decltype(&av_free)> ctx{ av_sha_alloc(), av_free };
     av_sha_init(ctx.get(), 160);
 
     try {
-        *Filesize = file.Size();
+        *Filesize = Reader ? Reader->Size() : file->Size();
+        if (*Filesize < 0)
+            throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_FILE_READ,
+                std::string("The size of '") + Filename + "' is unknown");
         std::vector<char> FileBuffer(static_cast<size_t>(std::min<int64_t>(1024 * 1024, *Filesize)));
-        size_t BytesRead = file.Read(FileBuffer.data(), FileBuffer.size());
+        size_t BytesRead = ReadAt(0, FileBuffer.data(), FileBuffer.size());
         av_sha_update(ctx.get(), reinterpret_cast<const uint8_t*>(FileBuffer.data()), BytesRead);
 
         if (*Filesize > static_cast<int64_t>(FileBuffer.size())) {
-            file.Seek(*Filesize - static_cast<int64_t>(FileBuffer.size()), SEEK_SET);
-            BytesRead = file.Read(FileBuffer.data(), FileBuffer.size());
+            BytesRead = ReadAt(*Filesize - static_cast<int64_t>(FileBuffer.size()), FileBuffer.data(), FileBuffer.size());
             av_sha_update(ctx.get(), reinterpret_cast<const uint8_t*>(FileBuffer.data()), BytesRead);
         }
     } catch (...) {
@@ -111,14 +136,15 @@ void FFMS_Index::Finalize(std::vector<SharedAVContext> const& video_contexts, co
     }
 }
 
-bool FFMS_Index::CompareFileSignature(const char *Filename) {
+bool FFMS_Index::CompareFileSignature(const char *Filename, const std::shared_ptr<InputReader> &Reader) {
     int64_t CFilesize;
     uint8_t CDigest[20];
-    CalculateFileSignature(Filename, &CFilesize, CDigest);
+    CalculateFileSignature(Filename, Reader, &CFilesize, CDigest);
     return (CFilesize == Filesize && !memcmp(CDigest, Digest, sizeof(Digest)));
 }
 
 void FFMS_Index::WriteIndex(ZipFile &zf) {
+    TraceSpan Span("index", "WriteIndex");
     // Write the index file header
     zf.Write<uint32_t>(INDEXID);
     zf.Write<uint32_t>(FFMS_VERSION);
@@ -161,6 +187,7 @@ uint8_t *FFMS_Index::WriteIndexBuffer(size_t *Size) {
 }
 
 void FFMS_Index::ReadIndex(ZipFile &zf, const char *IndexFile) {
+    TraceSpan Span("index", "ReadIndex");
     // Read the index file header
     if (zf.Read<uint32_t>() != INDEXID)
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
@@ -265,8 +292,16 @@ void FFMS_Indexer::SetProgressCallback(TIndexCallback IC_, void *ICPrivate_) {
     ICPrivate = ICPrivate_;
 }
 
-FFMS_Indexer::FFMS_Indexer(const char *Filename, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions)
-    : SourceFile(Filename) {
+void FFMS_Indexer::SetVerifySeekPoints(bool Verify) {
+    VerifySeekPoints = Verify;
+}
+
+void FFMS_Indexer::SetReadAhead(int BufferSize, int Depth) {
+    ::SetReadAhead(Reader.get(), BufferSize, Depth);
+}
+
+FFMS_Indexer::FFMS_Indexer(const char *Filename, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions, const std::shared_ptr<InputReader> &Reader)
+    : SourceFile(Filename), Reader(Reader) {
     try {
         AVDictionary *Dict = nullptr;
         for (int i = 0; i < NumOptions; i++) {
@@ -277,16 +312,20 @@ FFMS_Indexer::FFMS_Indexer(const char *Filename, const FFMS_KeyValuePair *Demuxe
             av_dict_set(&Dict, DemuxerOptions[i].Key, DemuxerOptions[i].Value, 0);
         }
 
-        if (avformat_open_input(&FormatContext, Filename, nullptr, &Dict) != 0)
+        // Indexing reads the whole file from start to end
+        if (!this->Reader)
+            this->Reader = OpenFileReader(Filename, AccessPattern::SEQUENTIAL);
+
+        if (OpenFormatContext(FormatContext, Filename, &Dict, this->Reader) != 0)
             throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
                 std::string("Can't open '") + Filename + "'");
 
         av_dict_free(&Dict);
 
-        FFMS_Index::CalculateFileSignature(Filename, &Filesize, Digest);
+        FFMS_Index::CalculateFileSignature(Filename, this->Reader, &Filesize, Digest);
 
         if (avformat_find_stream_info(FormatContext, nullptr) < 0) {
-            avformat_close_input(&FormatContext);
+            CloseFormatContext(FormatContext);
             throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
                 "Couldn't find stream information");
         }
@@ -407,7 +446,7 @@ void FFMS_Indexer::ParseVideoPacket(SharedAVContext &VideoContext, const AVPacke
 
 void FFMS_Indexer::Free() {
     av_frame_free(&DecodeFrame);
-    avformat_close_input(&FormatContext);
+    CloseFormatContext(FormatContext);
 }
 
 FFMS_Indexer::~FFMS_Indexer() {
@@ -438,6 +477,7 @@ const char *FFMS_Indexer::GetTrackMetadata(int Track, const char *Key) {
 }
 
 FFMS_Index *FFMS_Indexer::DoIndexing() {
+    TraceSpan Span("index", "DoIndexing");
     std::vector<SharedAVContext> AVContexts(FormatContext->nb_streams);
 
     auto TrackIndices = std::unique_ptr<FFMS_Index>(new FFMS_Index(Filesize, Digest, ErrorHandling, LAVFOpts));
@@ -512,6 +552,7 @@ FFMS_Index *FFMS_Indexer::DoIndexing() {
     std::vector<int64_t> LastValidTS(FormatContext->nb_streams, AV_NOPTS_VALUE);
 
     int64_t filesize = avio_size(FormatContext->pb);
+    int64_t TracedPos = -1;
     enum AVPictureStructure LastPicStruct = AV_PICTURE_STRUCTURE_UNKNOWN;
     int ret;
     while ((ret = av_read_frame(FormatContext, Packet.get())) >= 0) {
@@ -523,6 +564,11 @@ FFMS_Index *FFMS_Indexer::DoIndexing() {
                     "Cancelled by user");
             }
         }
+        // Every packet would make the trace huge so only record progress in steps of 1%
+        if (IsTracing() && FormatContext->pb && filesize > 0 && FormatContext->pb->pos - TracedPos > filesize / 100) {
+            TracedPos = FormatContext->pb->pos;
+            TraceCounter("index", "IndexingProgress", TracedPos);
+        }
         if (!IndexMask.count(Packet->stream_index)) {
             av_packet_unref(Packet.get());
             continue;
@@ -592,9 +638,70 @@ FFMS_Index *FFMS_Indexer::DoIndexing() {
             "Indexing failed: " + AVErrorToString(ret));
 
     TrackIndices->Finalize(AVContexts, FormatContext->iformat->name);
+
+    if (VerifySeekPoints) {
+        for (int Track : IndexMask) {
+            FFMS_Track &TrackInfo = (*TrackIndices)[Track];
+            if (TrackInfo.TT == FFMS_TYPE_VIDEO && !TrackInfo.empty() && AVContexts[Track].CodecContext)
+                VerifyTrackSeekPoints(Track, TrackInfo, AVContexts[Track].CodecContext, IsMpegLike);
+        }
+    }
+
     return TrackIndices.release();
 }
 
+// Seeks to every keyframe the same way FFMS_VideoSource::Seek does and marks the ones where that doesn't
+// end up on a packet that's known and can be decoded, so seeking skips them instead of finding out the hard way
+void FFMS_Indexer::VerifyTrackSeekPoints(int Track, FFMS_Track &TrackInfo, AVCodecContext *CodecContext, bool SeekByPos) {
+    TraceSpan Span("index", "VerifySeekPoints", Track);
+    SmartAVPacket Packet;
+    for (size_t i = 0; i < TrackInfo.size(); i++) {
+        const FrameInfo &Frame = TrackInfo[i];
+        if (!Frame.KeyFrame)
+            continue;
+
+        if (IC && (*IC)(i, TrackInfo.size(), ICPrivate))
+            throw FFMS_Exception(FFMS_ERROR_CANCELLED, FFMS_ERROR_USER,
+                "Cancelled by user");
+
+        int ret = -1;
+        if (!SeekByPos || Frame.FilePos < 0)
+            ret = av_seek_frame(FormatContext, Track, Frame.PTS, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0 && Frame.FilePos >= 0)
+            ret = av_seek_frame(FormatContext, Track, Frame.FilePos, AVSEEK_FLAG_BYTE);
+        avcodec_flush_buffers(CodecContext);
+
+        bool Usable = false;
+        if (ret >= 0) {
+            bool Sent = false;
+            while ((ret = av_read_frame(FormatContext, Packet.get())) >= 0) {
+                if (Packet->stream_index == Track) {
+                    int PacketNum = TrackInfo.FindPacket(*Packet);
+                    if (PacketNum == static_cast<int>(i))
+                        Sent = avcodec_send_packet(CodecContext, Packet.get()) == 0;
+                    // Landing before the keyframe only means decoding a bit more
+                    else if (PacketNum >= 0)
+                        Usable = TrackInfo[PacketNum].PosInDecodingOrder < Frame.PosInDecodingOrder;
+                    break;
+                }
+                av_packet_unref(Packet.get());
+            }
+            av_packet_unref(Packet.get());
+            if (IsIOError(ret))
+                throw FFMS_Exception(FFMS_ERROR_INDEXING, FFMS_ERROR_FILE_READ,
+                    "Seek point verification failed: " + AVErrorToString(ret));
+
+            // The decoder refuses to output anything when the frame isn't really a keyframe
+            if (Sent && avcodec_send_packet(CodecContext, nullptr) == 0)
+                Usable = avcodec_receive_frame(CodecContext, DecodeFrame) == 0;
+        }
+
+        if (!Usable)
+            TrackInfo.MarkBadSeekPoint(i);
+    }
+    avcodec_flush_buffers(CodecContext);
+}
+
 void FFMS_Indexer::ReadTS(const AVPacket &Packet, int64_t &TS, bool &UseDTS) {
     if (!UseDTS && Packet.pts != AV_NOPTS_VALUE)
         TS = Packet.pts;
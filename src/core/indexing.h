@@ -48,7 +48,7 @@ struct FFMS_Index : public std::vector<FFMS_Track> {
     void ReadIndex(ZipFile &zf, const char* IndexFile);
     void WriteIndex(ZipFile &zf);
 public:
-    static void CalculateFileSignature(const char *Filename, int64_t *Filesize, uint8_t Digest[20]);
+    static void CalculateFileSignature(const char *Filename, const std::shared_ptr<InputReader> &Reader, int64_t *Filesize, uint8_t Digest[20]);
 
     int ErrorHandling;
     int64_t Filesize;
@@ -56,7 +56,7 @@ public:
     std::map<std::string, std::string> LAVFOpts;
 
     void Finalize(std::vector<SharedAVContext> const& video_contexts, const char *Format);
-    bool CompareFileSignature(const char *Filename);
+    bool CompareFileSignature(const char *Filename, const std::shared_ptr<InputReader> &Reader = nullptr);
     void WriteIndexFile(const char *IndexFile);
     uint8_t *WriteIndexBuffer(size_t *Size);
 
@@ -74,9 +74,11 @@ private:
     std::set<int> IndexMask;
     std::map<std::string, std::string> LAVFOpts;
     int ErrorHandling = FFMS_IEH_CLEAR_TRACK;
+    bool VerifySeekPoints = false;
     TIndexCallback IC = nullptr;
     void *ICPrivate = nullptr;
     std::string SourceFile;
+    std::shared_ptr<InputReader> Reader;
     AVFrame *DecodeFrame = nullptr;
 
     int64_t Filesize;
@@ -85,16 +87,19 @@ private:
     void ReadTS(const AVPacket &Packet, int64_t &TS, bool &UseDTS);
     void CheckAudioProperties(int Track, AVCodecContext *Context);
     uint32_t IndexAudioPacket(int Track, const AVPacket &Packet, SharedAVContext &Context, FFMS_Index &TrackIndices);
+    void VerifyTrackSeekPoints(int Track, FFMS_Track &TrackInfo, AVCodecContext *CodecContext, bool SeekByPos);
     void ParseVideoPacket(SharedAVContext &VideoContext, const AVPacket &pkt, int *RepeatPict, int *FrameType, bool *Invisible, bool *SecondField, enum AVPictureStructure *LastPicStruct);
     void Free();
 public:
-    FFMS_Indexer(const char *Filename, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions);
+    FFMS_Indexer(const char *Filename, const FFMS_KeyValuePair *DemuxerOptions, int NumOptions, const std::shared_ptr<InputReader> &Reader = nullptr);
     ~FFMS_Indexer();
 
     void SetIndexTrack(int Track, bool Index);
     void SetIndexTrackType(int TrackType, bool Index);
     void SetErrorHandling(int ErrorHandling_);
     void SetProgressCallback(TIndexCallback IC_, void *ICPrivate_);
+    void SetVerifySeekPoints(bool Verify);
+    void SetReadAhead(int BufferSize, int Depth);
 
     FFMS_Index *DoIndexing();
     int GetNumberOfTracks();
@@ -0,0 +1,470 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "inputreader.h"
+
+#include "filehandle.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+std::atomic<bool> MemoryMappedInput{ false };
+ReadAheadSettings DefaultReadAhead;
+
+namespace {
+constexpr int IOBufferSize = 64 * 1024;
+
+// Keeps the reads after the position of one format context coming in on a thread of its own. Reading
+// anywhere else than right after the last read counts as a seek, which throws away everything read
+// ahead and ignores the result of the read in progress.
+class ReadAheadStream {
+    struct Block {
+        int64_t Offset;
+        std::vector<uint8_t> Data;
+    };
+
+    std::shared_ptr<InputReader> Reader;
+    std::mutex Mutex;
+    std::condition_variable Wake;
+    std::condition_variable Ready;
+    std::thread Thread;
+    // Contiguous and starting at or before the position
+    std::deque<Block> Blocks;
+    std::vector<std::vector<uint8_t>> Spare;
+    int64_t Next = 0;
+    // Set by the reader, so the thread never waits for a depth the reader no longer wants
+    int Depth = 0;
+    // Bumped by every seek, reads started before it are thrown away
+    unsigned Generation = 0;
+    // Whether the thread stopped at Next because of the end of the input (0) or an error
+    bool Halted = false;
+    int HaltResult = 0;
+    bool Stop = false;
+
+    void Restart(int64_t Offset) {
+        Generation++;
+        for (auto &Block : Blocks)
+            Recycle(std::move(Block.Data));
+        Blocks.clear();
+        Next = Offset;
+        Halted = false;
+    }
+
+    void Recycle(std::vector<uint8_t> &&Data) {
+        if (static_cast<int>(Spare.size()) < Depth)
+            Spare.push_back(std::move(Data));
+    }
+
+    void Run() {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        while (true) {
+            Wake.wait(Lock, [&] { return Stop || (!Halted && static_cast<int>(Blocks.size()) < Depth); });
+            if (Stop)
+                return;
+
+            int64_t Offset = Next;
+            unsigned StartGeneration = Generation;
+            std::vector<uint8_t> Data;
+            if (!Spare.empty()) {
+                Data = std::move(Spare.back());
+                Spare.pop_back();
+            }
+            Data.resize(Reader->ReadAhead.BufferSize);
+
+            Lock.unlock();
+            int Ret = Reader->Read(Offset, Data.data(), static_cast<int>(Data.size()));
+            Lock.lock();
+
+            if (StartGeneration != Generation) {
+                Recycle(std::move(Data));
+                continue;
+            }
+            if (Ret <= 0) {
+                Halted = true;
+                HaltResult = Ret;
+                Recycle(std::move(Data));
+            } else {
+                Data.resize(Ret);
+                Blocks.push_back({ Offset, std::move(Data) });
+                Next += Ret;
+            }
+            Ready.notify_all();
+        }
+    }
+
+public:
+    explicit ReadAheadStream(const std::shared_ptr<InputReader> &Reader) : Reader(Reader) {}
+
+    ~ReadAheadStream() {
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Stop = true;
+        }
+        Wake.notify_all();
+        if (Thread.joinable())
+            Thread.join();
+    }
+
+    int Read(int64_t Offset, uint8_t *Buf, int Size) {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        Depth = Reader->ReadAhead.Depth;
+
+        while (!Blocks.empty() && Blocks.front().Offset + static_cast<int64_t>(Blocks.front().Data.size()) <= Offset) {
+            Recycle(std::move(Blocks.front().Data));
+            Blocks.pop_front();
+        }
+        if (Blocks.empty() ? Next != Offset : Blocks.front().Offset > Offset)
+            Restart(Offset);
+
+        if (Depth > 0 && !Thread.joinable()) {
+            try {
+                Thread = std::thread(&ReadAheadStream::Run, this);
+            } catch (std::system_error &) {
+                Depth = 0;
+            }
+        }
+
+        if (Depth <= 0) {
+            Restart(Offset);
+            Lock.unlock();
+            int Ret = Reader->Read(Offset, Buf, Size);
+            Lock.lock();
+            if (Ret > 0)
+                Next += Ret;
+            return Ret;
+        }
+
+        Wake.notify_one();
+        Ready.wait(Lock, [&] { return !Blocks.empty() || Halted; });
+        if (Blocks.empty()) {
+            // Errors are retried by the next read, the end stays the end
+            if (HaltResult < 0)
+                Halted = false;
+            return HaltResult;
+        }
+
+        int Count = 0;
+        while (Count < Size && !Blocks.empty()) {
+            Block &Front = Blocks.front();
+            size_t Start = static_cast<size_t>(Offset + Count - Front.Offset);
+            size_t Length = std::min<size_t>(Size - Count, Front.Data.size() - Start);
+            memcpy(Buf + Count, Front.Data.data() + Start, Length);
+            Count += static_cast<int>(Length);
+            if (Start + Length == Front.Data.size()) {
+                Recycle(std::move(Front.Data));
+                Blocks.pop_front();
+            }
+        }
+        Wake.notify_one();
+        return Count;
+    }
+};
+
+struct InputPosition {
+    std::shared_ptr<InputReader> Reader;
+    int64_t Pos;
+    ReadAheadStream Stream;
+
+    explicit InputPosition(const std::shared_ptr<InputReader> &Reader) : Reader(Reader), Pos(0), Stream(Reader) {}
+};
+
+int ReadInput(void *Opaque, uint8_t *Buf, int Size) {
+    InputPosition *Position = static_cast<InputPosition *>(Opaque);
+    int Ret = Position->Stream.Read(Position->Pos, Buf, Size);
+    if (Ret == 0)
+        return AVERROR_EOF;
+    if (Ret > 0)
+        Position->Pos += Ret;
+    return Ret;
+}
+
+int64_t SeekInput(void *Opaque, int64_t Offset, int Whence) {
+    InputPosition *Position = static_cast<InputPosition *>(Opaque);
+    if (Whence & AVSEEK_SIZE)
+        return Position->Reader->Size();
+
+    switch (Whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        Offset += Position->Pos;
+        break;
+    case SEEK_END: {
+        int64_t Size = Position->Reader->Size();
+        if (Size < 0)
+            return AVERROR(ENOSYS);
+        Offset += Size;
+        break;
+    }
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (Offset < 0)
+        return AVERROR(EINVAL);
+    Position->Pos = Offset;
+    return Offset;
+}
+
+// Reads are plain copies out of the mapping so the demuxer never waits on a read syscall
+class MappedFileReader : public InputReader {
+    const uint8_t *Data;
+    int64_t FileSize;
+public:
+    MappedFileReader(const uint8_t *Data, int64_t FileSize) : Data(Data), FileSize(FileSize) {}
+
+    ~MappedFileReader() {
+#ifdef _WIN32
+        UnmapViewOfFile(Data);
+#else
+        munmap(const_cast<uint8_t *>(Data), static_cast<size_t>(FileSize));
+#endif
+    }
+
+    int64_t Size() override {
+        return FileSize;
+    }
+
+    int Read(int64_t Offset, uint8_t *Buf, int Size) override {
+        if (Offset >= FileSize)
+            return 0;
+        int Count = static_cast<int>(std::min<int64_t>(Size, FileSize - Offset));
+        memcpy(Buf, Data + Offset, Count);
+        return Count;
+    }
+
+    std::string Key() const override {
+        return std::string();
+    }
+};
+
+// Positional reads from a file opened with libavformat's file protocol
+class FileReader : public InputReader {
+    FileHandle File;
+    int64_t FileSize;
+    std::mutex Mutex;
+public:
+    explicit FileReader(const char *SourceFile)
+        : File(SourceFile, "rb", FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ), FileSize(File.Size()) {}
+
+    int64_t Size() override {
+        return FileSize;
+    }
+
+    int Read(int64_t Offset, uint8_t *Buf, int Size) override {
+        if (Offset >= FileSize)
+            return 0;
+        std::lock_guard<std::mutex> Lock(Mutex);
+        try {
+            File.Seek(Offset, SEEK_SET);
+            return static_cast<int>(File.Read(reinterpret_cast<char *>(Buf), Size));
+        } catch (FFMS_Exception &) {
+            return AVERROR(EIO);
+        }
+    }
+
+    std::string Key() const override {
+        return std::string();
+    }
+};
+
+void FreeInputContext(AVIOContext *&IO) {
+    if (!IO)
+        return;
+    delete static_cast<InputPosition *>(IO->opaque);
+    av_freep(&IO->buffer);
+    avio_context_free(&IO);
+}
+}
+
+void ReadAheadSettings::Set(int BufferSize, int Depth) {
+    if (BufferSize < 4096 || BufferSize > 64 * 1024 * 1024 || Depth < 0 || Depth > 1024)
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_INVALID_ARGUMENT,
+            "The read-ahead buffer size must be between 4 KiB and 64 MiB and the depth between 0 and 1024");
+    this->BufferSize = BufferSize;
+    this->Depth = Depth;
+}
+
+InputReader::InputReader() {
+    ReadAhead.BufferSize = DefaultReadAhead.BufferSize.load();
+    ReadAhead.Depth = DefaultReadAhead.Depth.load();
+}
+
+UserInputReader::UserInputReader(const char *Name, const FFMS_Input *Input) {
+    if (!Input || (Input->Buffer ? Input->BufferSize < 0 : !Input->Read))
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_INVALID_ARGUMENT,
+            std::string("The input for '") + Name + "' needs either a buffer or a read callback");
+    this->Input = *Input;
+}
+
+int64_t UserInputReader::Size() {
+    if (Input.Buffer)
+        return Input.BufferSize;
+    if (!Input.GetSize)
+        return -1;
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Input.GetSize(Input.Private);
+}
+
+int UserInputReader::Read(int64_t Offset, uint8_t *Buf, int Size) {
+    if (Input.Buffer) {
+        if (Offset >= Input.BufferSize)
+            return 0;
+        int Count = static_cast<int>(std::min<int64_t>(Size, Input.BufferSize - Offset));
+        memcpy(Buf, Input.Buffer + Offset, Count);
+        return Count;
+    }
+    std::lock_guard<std::mutex> Lock(Mutex);
+    int Ret = Input.Read(Input.Private, Offset, Buf, Size);
+    return Ret < 0 ? AVERROR(EIO) : Ret;
+}
+
+std::string UserInputReader::Key() const {
+    if (Input.Buffer)
+        return "buffer:" + std::to_string(reinterpret_cast<uintptr_t>(Input.Buffer)) + ":" + std::to_string(Input.BufferSize);
+    return "callbacks:" + std::to_string(reinterpret_cast<uintptr_t>(Input.Read)) + ":" + std::to_string(reinterpret_cast<uintptr_t>(Input.Private));
+}
+
+// Reading a mapping beyond the end of a file that was truncated in the meantime raises SIGBUS on POSIX
+// systems, where a read call would merely fail. Windows refuses to truncate mapped files instead.
+static std::shared_ptr<InputReader> MapFile(const char *SourceFile, AccessPattern Pattern) {
+#ifdef _WIN32
+    int Length = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, SourceFile, -1, nullptr, 0);
+    if (Length <= 0)
+        return nullptr;
+    std::wstring WideFile(Length, L'\0');
+    MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, SourceFile, -1, &WideFile[0], Length);
+
+    // The mapping has no access hints of its own but the cache manager follows those of the file handle
+    DWORD Hint = Pattern == AccessPattern::SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN :
+        Pattern == AccessPattern::RANDOM ? FILE_FLAG_RANDOM_ACCESS : 0;
+    HANDLE File = CreateFileW(WideFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | Hint, nullptr);
+    if (File == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER FileSize;
+    const void *Data = nullptr;
+    if (GetFileType(File) == FILE_TYPE_DISK && GetFileSizeEx(File, &FileSize) && FileSize.QuadPart > 0 &&
+        static_cast<uint64_t>(FileSize.QuadPart) <= SIZE_MAX) {
+        HANDLE Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (Mapping) {
+            Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+            // The view keeps both alive
+            CloseHandle(Mapping);
+        }
+    }
+    CloseHandle(File);
+    if (!Data)
+        return nullptr;
+    return std::make_shared<MappedFileReader>(static_cast<const uint8_t *>(Data), FileSize.QuadPart);
+#else
+    int File = open(SourceFile, O_RDONLY);
+    if (File < 0)
+        return nullptr;
+    struct stat Stat;
+    void *Data = MAP_FAILED;
+    if (!fstat(File, &Stat) && S_ISREG(Stat.st_mode) && Stat.st_size > 0 &&
+        static_cast<uint64_t>(Stat.st_size) <= SIZE_MAX)
+        Data = mmap(nullptr, static_cast<size_t>(Stat.st_size), PROT_READ, MAP_SHARED, File, 0);
+    // The mapping keeps the file open
+    close(File);
+    if (Data == MAP_FAILED)
+        return nullptr;
+
+    // Only a hint, so failing is harmless
+    if (Pattern == AccessPattern::SEQUENTIAL)
+        madvise(Data, static_cast<size_t>(Stat.st_size), MADV_SEQUENTIAL);
+    else if (Pattern == AccessPattern::RANDOM)
+        madvise(Data, static_cast<size_t>(Stat.st_size), MADV_RANDOM);
+    return std::make_shared<MappedFileReader>(static_cast<const uint8_t *>(Data), Stat.st_size);
+#endif
+}
+
+std::shared_ptr<InputReader> OpenFileReader(const char *SourceFile, AccessPattern Pattern) {
+    // Other protocols may need options only libavformat knows what to do with
+    const char *Protocol = avio_find_protocol_name(SourceFile);
+    if (!Protocol || strcmp(Protocol, "file"))
+        return nullptr;
+
+    if (MemoryMappedInput) {
+        std::shared_ptr<InputReader> Mapped = MapFile(SourceFile, Pattern);
+        if (Mapped)
+            return Mapped;
+    }
+    if (DefaultReadAhead.Depth > 0) {
+        try {
+            return std::make_shared<FileReader>(SourceFile);
+        } catch (FFMS_Exception &) {
+        }
+    }
+    return nullptr;
+}
+
+void SetReadAhead(InputReader *Reader, int BufferSize, int Depth) {
+    if (!Reader)
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_UNSUPPORTED,
+            "Read-ahead can only be changed for files opened while read-ahead or memory mapping was enabled, or read from an FFMS_Input");
+    Reader->ReadAhead.Set(BufferSize, Depth);
+}
+
+int OpenFormatContext(AVFormatContext *&FormatContext, const char *SourceFile, AVDictionary **Options, const std::shared_ptr<InputReader> &Reader) {
+    if (!Reader)
+        return avformat_open_input(&FormatContext, SourceFile, nullptr, Options);
+
+    FormatContext = avformat_alloc_context();
+    uint8_t *Buffer = static_cast<uint8_t *>(av_malloc(IOBufferSize));
+    InputPosition *Position = new InputPosition(Reader);
+    AVIOContext *IO = (FormatContext && Buffer) ? avio_alloc_context(Buffer, IOBufferSize, 0, Position, ReadInput, nullptr, SeekInput) : nullptr;
+    if (!IO) {
+        av_free(Buffer);
+        delete Position;
+        avformat_free_context(FormatContext);
+        FormatContext = nullptr;
+        return AVERROR(ENOMEM);
+    }
+
+    FormatContext->pb = IO;
+    FormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    int Ret = avformat_open_input(&FormatContext, SourceFile, nullptr, Options);
+    // The context is gone on failure but a custom AVIOContext never belongs to it
+    if (Ret < 0)
+        FreeInputContext(IO);
+    return Ret;
+}
+
+void CloseFormatContext(AVFormatContext *&FormatContext) {
+    AVIOContext *IO = (FormatContext && (FormatContext->flags & AVFMT_FLAG_CUSTOM_IO)) ? FormatContext->pb : nullptr;
+    avformat_close_input(&FormatContext);
+    FreeInputContext(IO);
+}
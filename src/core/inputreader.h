@@ -0,0 +1,99 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef INPUTREADER_H
+#define INPUTREADER_H
+
+#include "ffms.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct AVDictionary;
+struct AVFormatContext;
+struct AVIOContext;
+
+// How far a background thread reads ahead of every format context opened on a reader, in Depth reads
+// of BufferSize bytes. A Depth of 0 reads synchronously.
+struct ReadAheadSettings {
+    std::atomic<int> BufferSize{ 1024 * 1024 };
+    std::atomic<int> Depth{ 0 };
+
+    // Throws unless both are within reasonable limits
+    void Set(int BufferSize, int Depth);
+};
+
+// What readers start out with
+extern ReadAheadSettings DefaultReadAhead;
+
+// Random access to a file libavformat can't open by itself. Every format context opened on a reader gets
+// its own position so any number of them, in any threads, can read through the same one.
+class InputReader {
+public:
+    ReadAheadSettings ReadAhead;
+
+    InputReader();
+    virtual ~InputReader() = default;
+    virtual int64_t Size() = 0;
+    // Reads up to Size bytes starting at Offset, returns the number of bytes read, 0 at the end or an AVERROR
+    virtual int Read(int64_t Offset, uint8_t *Buf, int Size) = 0;
+    // Equal for readers of the same data, so sources of it can share a demuxer. Empty when the reader
+    // reads exactly the file named by the source file.
+    virtual std::string Key() const = 0;
+};
+
+// Reads from an FFMS_Input, either its buffer or its callbacks
+class UserInputReader : public InputReader {
+    FFMS_Input Input;
+    // The callbacks are never called concurrently through the same reader
+    std::mutex Mutex;
+public:
+    UserInputReader(const char *Name, const FFMS_Input *Input);
+    int64_t Size() override;
+    int Read(int64_t Offset, uint8_t *Buf, int Size) override;
+    std::string Key() const override;
+};
+
+// Whether local files are read through a memory mapping instead of libavformat's file protocol
+extern std::atomic<bool> MemoryMappedInput;
+
+enum class AccessPattern {
+    NORMAL,
+    SEQUENTIAL,
+    RANDOM
+};
+
+// A reader for a local SourceFile when memory mapping or read-ahead is on, preferably a mapping that the
+// OS is told how it's going to be read. Returns nullptr when both are off or SourceFile isn't a local file,
+// which leaves it to libavformat.
+std::shared_ptr<InputReader> OpenFileReader(const char *SourceFile, AccessPattern Pattern);
+
+// Changes the read-ahead of all format contexts opened on Reader, throws if there is no reader to change
+void SetReadAhead(InputReader *Reader, int BufferSize, int Depth);
+
+// avformat_open_input, reading through Reader instead of opening SourceFile when there is one
+int OpenFormatContext(AVFormatContext *&FormatContext, const char *SourceFile, AVDictionary **Options, const std::shared_ptr<InputReader> &Reader);
+// avformat_close_input that also frees what OpenFormatContext created for a reader
+void CloseFormatContext(AVFormatContext *&FormatContext);
+
+#endif
@@ -0,0 +1,77 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "memorygovernor.h"
+
+#include "ffms.h"
+
+#include <algorithm>
+
+MemoryGovernor::MemoryGovernor() {
+    for (auto &Value : Usage)
+        Value = 0;
+}
+
+MemoryGovernor &MemoryGovernor::Instance() {
+    static MemoryGovernor Governor;
+    return Governor;
+}
+
+void MemoryGovernor::SetLimit(int64_t Bytes) {
+    Limit = Bytes;
+}
+
+void MemoryGovernor::Add(Category C, int64_t Bytes) {
+    Usage[C] += Bytes;
+}
+
+int64_t MemoryGovernor::Total() const {
+    int64_t Sum = 0;
+    for (const auto &Value : Usage)
+        Sum += Value;
+    return Sum;
+}
+
+bool MemoryGovernor::OverLimit(int64_t Extra) const {
+    int64_t Max = Limit;
+    return Max > 0 && Total() + Extra > Max;
+}
+
+int MemoryGovernor::LimitThreads(int Threads) const {
+    int64_t Max = Limit;
+    if (Max <= 0)
+        return Threads;
+    // Every frame thread keeps its own set of frames alive so halve them well before the limit is reached
+    int64_t Used = Total();
+    if (Used >= Max)
+        return 1;
+    if (Used >= Max / 4 * 3)
+        return std::max(1, Threads / 2);
+    return Threads;
+}
+
+void MemoryGovernor::GetUsage(FFMS_MemoryUsage &Out) const {
+    Out.Limit = Limit;
+    Out.VideoFrameCaches = Usage[FRAME_CACHE];
+    Out.AudioCaches = Usage[AUDIO_CACHE];
+    Out.Decoders = Usage[DECODER];
+    Out.SharedDemuxers = Usage[DEMUXER];
+    Out.Total = Out.VideoFrameCaches + Out.AudioCaches + Out.Decoders + Out.SharedDemuxers;
+}
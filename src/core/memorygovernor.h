@@ -0,0 +1,79 @@
+//  Copyright (c) 2007-2015 The FFmpegSource Project
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef MEMORYGOVERNOR_H
+#define MEMORYGOVERNOR_H
+
+#include <atomic>
+#include <cstdint>
+
+struct FFMS_MemoryUsage;
+
+// Process wide accounting of the memory held by all sources, see FFMS_SetMemoryLimit.
+// Nothing is ever refused, instead the caches consult OverLimit before growing and give
+// memory back when it returns true.
+class MemoryGovernor {
+public:
+    enum Category {
+        FRAME_CACHE,
+        AUDIO_CACHE,
+        DECODER,
+        DEMUXER,
+        CATEGORY_COUNT
+    };
+
+private:
+    std::atomic<int64_t> Usage[CATEGORY_COUNT];
+    std::atomic<int64_t> Limit{ 0 };
+
+    MemoryGovernor();
+
+public:
+    static MemoryGovernor &Instance();
+
+    void SetLimit(int64_t Bytes);
+    void Add(Category C, int64_t Bytes);
+    int64_t Total() const;
+    // True when there's a limit and Extra more bytes would exceed it
+    bool OverLimit(int64_t Extra = 0) const;
+    // Decoder threads to use for a newly opened source, fewer the closer usage is to the limit
+    int LimitThreads(int Threads) const;
+    void GetUsage(FFMS_MemoryUsage &Out) const;
+};
+
+// The share of a single cache or decoder in its category, given back on destruction
+class MemoryCharge {
+    MemoryGovernor::Category C;
+    int64_t Bytes = 0;
+public:
+    explicit MemoryCharge(MemoryGovernor::Category C) : C(C) {}
+    MemoryCharge(const MemoryCharge &) = delete;
+    MemoryCharge &operator=(const MemoryCharge &) = delete;
+    ~MemoryCharge() { Set(0); }
+
+    void Set(int64_t NewBytes) {
+        if (NewBytes != Bytes)
+            MemoryGovernor::Instance().Add(C, NewBytes - Bytes);
+        Bytes = NewBytes;
+    }
+    int64_t Get() const { return Bytes; }
+};
+
+#endif
@@ -0,0 +1,136 @@
+//  Copyright (c) 2007-2017 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "trace.h"
+
+#include "filehandle.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+std::atomic<bool> TraceEnabled{ false };
+
+namespace {
+// Events are collected here and written in large chunks since FileHandle flushes on every write
+class TraceWriter {
+    std::mutex Mutex;
+    std::unique_ptr<FileHandle> File;
+    std::string Buffer;
+    bool FirstEvent = true;
+
+    void Flush() {
+        File->Write(Buffer.data(), Buffer.size());
+        Buffer.clear();
+    }
+
+    void Close() {
+        TraceEnabled = false;
+        if (!File)
+            return;
+        Buffer += "\n]\n";
+        try {
+            Flush();
+        } catch (FFMS_Exception &) {
+        }
+        File.reset();
+        Buffer.clear();
+    }
+
+public:
+    ~TraceWriter() {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Close();
+    }
+
+    void Open(const char *Filename) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Close();
+        if (!Filename)
+            return;
+        File.reset(new FileHandle(Filename, "wb", FFMS_ERROR_TRACE, FFMS_ERROR_FILE_WRITE));
+        Buffer = "[\n";
+        FirstEvent = true;
+        TraceEnabled = true;
+    }
+
+    void Append(const char *Event) {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        if (!File)
+            return;
+        if (!FirstEvent)
+            Buffer += ",\n";
+        FirstEvent = false;
+        Buffer += Event;
+        if (Buffer.size() >= 64 * 1024) {
+            // Failing to write the trace shouldn't fail whatever was being traced so just stop tracing
+            try {
+                Flush();
+            } catch (FFMS_Exception &) {
+                TraceEnabled = false;
+                File.reset();
+                Buffer.clear();
+            }
+        }
+    }
+};
+
+TraceWriter &Writer() {
+    static TraceWriter Instance;
+    return Instance;
+}
+
+// Small sequential ids make for a more readable trace than hashed thread ids
+int ThreadId() {
+    static std::atomic<int> NextId{ 1 };
+    thread_local int Id = NextId++;
+    return Id;
+}
+}
+
+void SetTraceFile(const char *Filename) {
+    Writer().Open(Filename);
+}
+
+int64_t TraceNow() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceComplete(const char *Category, const char *Name, int64_t Start, int64_t Arg) {
+    int64_t End = TraceNow();
+    char Event[256];
+    if (Arg >= 0)
+        snprintf(Event, sizeof(Event), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%d,\"args\":{\"n\":%" PRId64 "}}",
+            Name, Category, Start, End - Start, ThreadId(), Arg);
+    else
+        snprintf(Event, sizeof(Event), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%d}",
+            Name, Category, Start, End - Start, ThreadId());
+    Writer().Append(Event);
+}
+
+void TraceCounter(const char *Category, const char *Name, int64_t Value) {
+    char Event[256];
+    snprintf(Event, sizeof(Event), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"C\",\"ts\":%" PRId64 ",\"pid\":1,\"tid\":%d,\"args\":{\"value\":%" PRId64 "}}",
+        Name, Category, TraceNow(), ThreadId(), Value);
+    Writer().Append(Event);
+}
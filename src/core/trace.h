@@ -0,0 +1,64 @@
+//  Copyright (c) 2007-2017 Fredrik Mellbin
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+// Chrome trace event output, see FFMS_SetTraceFile. Everything is guarded by TraceEnabled so
+// a disabled trace costs one relaxed load and a branch per span.
+extern std::atomic<bool> TraceEnabled;
+
+// Replaces the current trace file, or only closes it when Filename is null
+void SetTraceFile(const char *Filename);
+// Microseconds on the clock the events are timestamped with
+int64_t TraceNow();
+// Arg is added to the event's arguments as "n" unless it's negative
+void TraceComplete(const char *Category, const char *Name, int64_t Start, int64_t Arg);
+void TraceCounter(const char *Category, const char *Name, int64_t Value);
+
+inline bool IsTracing() {
+    return TraceEnabled.load(std::memory_order_relaxed);
+}
+
+// Records the time between construction and destruction as a single event
+class TraceSpan {
+    const char *Category;
+    const char *Name = nullptr;
+    int64_t Start = 0;
+    int64_t Arg;
+public:
+    TraceSpan(const char *Category, const char *Name, int64_t Arg = -1) : Category(Category), Arg(Arg) {
+        if (IsTracing()) {
+            this->Name = Name;
+            Start = TraceNow();
+        }
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+    ~TraceSpan() {
+        if (Name)
+            TraceComplete(Category, Name, Start, Arg);
+    }
+};
+
+#endif
@@ -52,6 +52,7 @@ FrameInfo ReadFrame(ZipFile &stream, FrameInfo const& prev, const FFMS_TrackType
         f.PosInDecodingOrder = static_cast<size_t>(stream.Read<uint64_t>() + prev.PosInDecodingOrder + 1);
         f.RepeatPict = stream.Read<int32_t>();
         f.SecondField = !!stream.Read<int8_t>();
+        f.BadSeekPoint = !!stream.Read<int8_t>();
     }
     return f;
 }
@@ -70,6 +71,7 @@ static void WriteFrame(ZipFile &stream, FrameInfo const& f, FrameInfo const& pre
         stream.Write(static_cast<uint64_t>(f.PosInDecodingOrder) - prev.PosInDecodingOrder - 1);
         stream.Write<int32_t>(f.RepeatPict);
         stream.Write<uint8_t>(f.SecondField);
+        stream.Write<uint8_t>(f.BadSeekPoint);
     }
 }
 }
@@ -143,6 +145,10 @@ void FFMS_Track::AddAudioFrame(int64_t PTS, int64_t DTS, int64_t SampleStart, ui
     }
 }
 
+void FFMS_Track::MarkBadSeekPoint(size_t Frame) {
+    Data->Frames[Frame].BadSeekPoint = true;
+}
+
 void FFMS_Track::WriteTimecodes(const char *TimecodeFile) const {
     frame_vec &Frames = Data->Frames;
     FileHandle file(TimecodeFile, "w", FFMS_ERROR_TRACK, FFMS_ERROR_FILE_WRITE);
@@ -259,7 +265,11 @@ int FFMS_Track::FindClosestVideoKeyFrame(int Frame) const {
     frame_vec &Frames = Data->Frames;
     Frame = std::min(std::max(Frame, 0), static_cast<int>(size()) - 1);
     size_t PosInDecodingOrder = Frames[Frame].PosInDecodingOrder;
-    for (; PosInDecodingOrder > 0 && !(Frames[Frames[PosInDecodingOrder].OriginalPos].KeyFrame && Frames[Frames[PosInDecodingOrder].OriginalPos].PTS <= Frames[Frame].PTS); PosInDecodingOrder--);
+    for (; PosInDecodingOrder > 0; PosInDecodingOrder--) {
+        const FrameInfo &Candidate = Frames[Frames[PosInDecodingOrder].OriginalPos];
+        if (Candidate.KeyFrame && !Candidate.BadSeekPoint && Candidate.PTS <= Frames[Frame].PTS)
+            break;
+    }
 
     return Frames[PosInDecodingOrder].OriginalPos;
 }
@@ -268,6 +278,15 @@ int FFMS_Track::RealFrameNumber(int Frame) const {
     return Data->RealFrameNumbers[Frame];
 }
 
+// Returns -1 for hidden frames
+int FFMS_Track::VisibleFrameNumber(int Frame) const {
+    const std::vector<int> &RealFrameNumbers = Data->RealFrameNumbers;
+    auto It = std::lower_bound(RealFrameNumbers.begin(), RealFrameNumbers.end(), Frame);
+    if (It == RealFrameNumbers.end() || *It != Frame)
+        return -1;
+    return static_cast<int>(It - RealFrameNumbers.begin());
+}
+
 int FFMS_Track::VisibleFrameCount() const {
     return TT == FFMS_TYPE_AUDIO ? static_cast<int>(Data->Frames.size()) : static_cast<int>(Data->RealFrameNumbers.size());
 }
@@ -45,6 +45,7 @@ struct FrameInfo {
     bool SecondField;
 
     int64_t DTS;        // Only used during indexing and not stored in the index file. (If UseDTS is true, the PTS values will be DTS)
+    bool BadSeekPoint;  // Keyframe that seeking was verified to not land on
 
     // If true, no frame corresponding to this packet will be output
     constexpr bool Skipped() const { return MarkedHidden || SecondField; }
@@ -81,11 +82,13 @@ public:
     void MaybeHideFrames();
     void FinalizeTrack();
     void FillAudioGaps();
+    void MarkBadSeekPoint(size_t Frame);
 
     int FindClosestVideoKeyFrame(int Frame) const;
     int FindPacket(const AVPacket &packet) const;
     int ClosestFrameFromPTS(int64_t PTS) const;
     int RealFrameNumber(int Frame) const;
+    int VisibleFrameNumber(int Frame) const;
     int VisibleFrameCount() const;
 
     const FFMS_FrameInfo *GetFrameInfo(size_t N) const;
@@ -25,6 +25,7 @@ extern "C" {
 #include "utils.h"
 
 #include "indexing.h"
+#include "inputreader.h"
 #include "track.h"
 
 #ifdef _WIN32
@@ -86,19 +87,19 @@ void FillAP(FFMS_AudioProperties &AP, AVCodecContext *CTX, FFMS_Track &Frames) {
     }
 }
 
-void LAVFOpenFile(const char *SourceFile, AVFormatContext *&FormatContext, int Track, const std::map<std::string, std::string> &LAVFOpts) {
+void LAVFOpenFile(const char *SourceFile, AVFormatContext *&FormatContext, int Track, const std::map<std::string, std::string> &LAVFOpts, const std::shared_ptr<InputReader> &Reader) {
     AVDictionary *Dict = nullptr;
     for (const auto &iter : LAVFOpts)
         av_dict_set(&Dict, iter.first.c_str(), iter.second.c_str(), 0);
 
-    if (avformat_open_input(&FormatContext, SourceFile, nullptr, &Dict) != 0)
+    if (OpenFormatContext(FormatContext, SourceFile, &Dict, Reader) != 0)
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
             std::string("Couldn't open '") + SourceFile + "'");
 
     av_dict_free(&Dict);
 
     if (avformat_find_stream_info(FormatContext, nullptr) < 0) {
-        avformat_close_input(&FormatContext);
+        CloseFormatContext(FormatContext);
         FormatContext = nullptr;
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
             "Couldn't find stream information");
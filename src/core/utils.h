@@ -35,12 +35,16 @@ extern "C" {
 // must be included after ffmpeg headers
 #include "ffmscompat.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <memory>
 #include <string>
 #include <vector>
 #include <map>
 
+class InputReader;
+
 class FFMS_Exception {
     std::string _Message;
     int _ErrorType;
@@ -61,7 +65,7 @@ std::unique_ptr<T> make_unique(Args&&... args) {
 void ClearErrorInfo(FFMS_ErrorInfo *ErrorInfo);
 void FillAP(FFMS_AudioProperties &AP, AVCodecContext *CTX, FFMS_Track &Frames);
 
-void LAVFOpenFile(const char *SourceFile, AVFormatContext *&FormatContext, int Track, const std::map<std::string, std::string> &LAVFOpts);
+void LAVFOpenFile(const char *SourceFile, AVFormatContext *&FormatContext, int Track, const std::map<std::string, std::string> &LAVFOpts, const std::shared_ptr<InputReader> &Reader = nullptr);
 
 // RAII wrapper for AVPacket * that handles av_packet_alloc and av_packet_free.
 // av_packet_ref and av_packet_unref still need to be handled by user code.
@@ -75,6 +79,31 @@ public:
     }
 };
 
+// Atomic because the threads using a decoder pool, the prefetch thread and readers of the stats may all touch them at once
+typedef std::atomic<int64_t> StatCounter;
+
+// Adds the time spent in its scope, in nanoseconds, to a StatCounter
+class ScopedStatTimer {
+    StatCounter *Counter;
+    std::chrono::steady_clock::time_point Start;
+public:
+    explicit ScopedStatTimer(StatCounter &Counter) : Counter(&Counter), Start(std::chrono::steady_clock::now()) {}
+    ScopedStatTimer(const ScopedStatTimer &) = delete;
+    ScopedStatTimer &operator=(const ScopedStatTimer &) = delete;
+    ~ScopedStatTimer() { Stop(); }
+
+    void Stop() {
+        if (Counter) {
+            *Counter += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count();
+            Counter = nullptr;
+        }
+    }
+};
+
+inline double StatSeconds(const StatCounter &Nanoseconds) {
+    return Nanoseconds / 1e9;
+}
+
 namespace optdetail {
     template<typename T>
     T get_av_opt(void *v, const char *name) {
@@ -20,9 +20,16 @@
 
 #include "videosource.h"
 #include "indexing.h"
+#include "inputreader.h"
+#include "trace.h"
 #include "videoutils.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <system_error>
 #include <thread>
+#include <type_traits>
 
 
 void DecoderDelay::Reset() {
@@ -50,6 +57,311 @@ bool DecoderDelay::IsExceeded() {
     return ThreadDelayCounter >= ThreadDelay && ReorderDelayCounter > ReorderDelay;
 }
 
+// Averages the first samples and then slowly follows changes, such as a switch to a different decode profile
+static void UpdateCostEstimate(double &Estimate, int &Samples, double Seconds) {
+    Samples = std::min(Samples + 1, 16);
+    Estimate += (Seconds - Estimate) / Samples;
+}
+
+void SeekCostModel::AddFrame(double Seconds) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    UpdateCostEstimate(FrameTime, FrameSamples, Seconds);
+}
+
+void SeekCostModel::AddSeek(double Seconds) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    UpdateCostEstimate(SeekTime, SeekSamples, Seconds);
+}
+
+void SeekCostModel::Get(double &FrameSeconds, double &SeekSeconds) const {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    FrameSeconds = FrameTime;
+    SeekSeconds = SeekTime;
+}
+
+int SeekCostModel::SeekDistance() const {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (FrameSamples < 4 || SeekSamples < 1 || FrameTime <= 0)
+        return DefaultSeekDistance;
+    return static_cast<int>(std::min<double>(std::ceil(SeekTime / FrameTime), std::numeric_limits<int>::max() / 2));
+}
+
+static size_t GetFrameBufferSize(const AVFrame *Frame) {
+    size_t Size = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+        if (Frame->buf[i])
+            Size += Frame->buf[i]->size;
+    for (int i = 0; i < Frame->nb_extended_buf; i++)
+        Size += Frame->extended_buf[i]->size;
+    return Size;
+}
+
+DecodedFrameCache::~DecodedFrameCache() {
+    Clear();
+}
+
+void DecodedFrameCache::EvictTo(size_t Limit) {
+    while (!Entries.empty() && CurrentSize > Limit) {
+        CacheEntry &Entry = Entries.back();
+        CurrentSize -= Entry.Size;
+        Lookup.erase(Entry.FrameNumber);
+        av_frame_free(&Entry.Frame);
+        Entries.pop_back();
+    }
+    Charge.Set(CurrentSize);
+}
+
+void DecodedFrameCache::SetMaxSize(size_t Bytes) {
+    MaxSize = Bytes;
+    EvictTo(MaxSize);
+}
+
+AVFrame *DecodedFrameCache::Get(int n) {
+    auto Iter = Lookup.find(n);
+    if (Iter == Lookup.end())
+        return nullptr;
+    Entries.splice(Entries.begin(), Entries, Iter->second);
+    return Iter->second->Frame;
+}
+
+void DecodedFrameCache::Add(int n, const AVFrame *Frame) {
+    if (MaxSize == 0 || Lookup.count(n))
+        return;
+
+    AVFrame *Ref = av_frame_alloc();
+    if (!Ref || av_frame_ref(Ref, Frame) < 0) {
+        av_frame_free(&Ref);
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference frame for caching");
+    }
+
+    size_t Size = GetFrameBufferSize(Ref);
+    if (Size > MaxSize) {
+        av_frame_free(&Ref);
+        return;
+    }
+
+    EvictTo(MaxSize - Size);
+    // When all sources together use too much memory the cache gives up its oldest frames first,
+    // and if that isn't enough it doesn't take the new one either
+    Shrink(Size);
+    if (MemoryGovernor::Instance().OverLimit(Size)) {
+        av_frame_free(&Ref);
+        return;
+    }
+
+    Entries.push_front({ n, Ref, Size });
+    Lookup[n] = Entries.begin();
+    CurrentSize += Size;
+    Charge.Set(CurrentSize);
+}
+
+void DecodedFrameCache::Shrink(size_t Extra) {
+    MemoryGovernor &Governor = MemoryGovernor::Instance();
+    while (!Entries.empty() && Governor.OverLimit(Extra))
+        EvictTo(CurrentSize - Entries.back().Size);
+}
+
+void DecodedFrameCache::Clear() {
+    for (auto &Entry : Entries)
+        av_frame_free(&Entry.Frame);
+    Entries.clear();
+    Lookup.clear();
+    CurrentSize = 0;
+    Charge.Set(0);
+}
+
+PacketCache::~PacketCache() {
+    Clear();
+}
+
+void PacketCache::DropOldest() {
+    // Runs are only dropped as a whole, except for the last one left which loses its oldest packets instead
+    Run &Oldest = Runs.back();
+    if (Runs.size() > 1) {
+        for (auto Packet : Oldest.Packets)
+            av_packet_free(&Packet);
+        CurrentSize -= Oldest.Size;
+        if (HaveLive && Live == std::prev(Runs.end()))
+            HaveLive = false;
+        Runs.pop_back();
+    } else {
+        CurrentSize -= Oldest.Packets.front()->size;
+        Oldest.Size -= Oldest.Packets.front()->size;
+        av_packet_free(&Oldest.Packets.front());
+        Oldest.Packets.pop_front();
+    }
+}
+
+void PacketCache::EvictTo(size_t Limit) {
+    MemoryGovernor &Governor = MemoryGovernor::Instance();
+    // A run that's being replayed has to stay intact so it's known where to continue afterwards
+    while (!Replaying && CurrentSize > 0 && (CurrentSize > Limit || Governor.OverLimit()))
+        DropOldest();
+    Charge.Set(CurrentSize);
+}
+
+void PacketCache::SetMaxSize(size_t Bytes) {
+    MaxSize = Bytes;
+    if (MaxSize == 0)
+        Clear();
+    else
+        EvictTo(MaxSize);
+}
+
+void PacketCache::StartRun() {
+    Replaying = false;
+    HaveLive = MaxSize > 0;
+    if (!HaveLive)
+        return;
+    // An empty run would only ever be evicted
+    if (!Runs.empty() && Runs.front().Packets.empty())
+        Runs.pop_front();
+    Runs.emplace_front();
+    Live = Runs.begin();
+}
+
+void PacketCache::Add(const AVPacket *Packet) {
+    if (!HaveLive || static_cast<size_t>(Packet->size) > MaxSize)
+        return;
+
+    AVPacket *Ref = av_packet_alloc();
+    if (!Ref || av_packet_ref(Ref, Packet) < 0) {
+        av_packet_free(&Ref);
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference packet for caching");
+    }
+    Live->Packets.push_back(Ref);
+    Live->Size += Ref->size;
+    CurrentSize += Ref->size;
+    EvictTo(MaxSize);
+}
+
+const AVPacket *PacketCache::Find(int64_t Pos) const {
+    if (Pos < 0)
+        return nullptr;
+    for (auto &Run : Runs) {
+        for (auto Packet : Run.Packets) {
+            if (Packet->pos == Pos)
+                return Packet;
+        }
+    }
+    return nullptr;
+}
+
+bool PacketCache::Seek(int64_t Pos) {
+    if (Pos < 0)
+        return false;
+    for (auto Iter = Runs.begin(); Iter != Runs.end(); ++Iter) {
+        for (size_t i = 0; i < Iter->Packets.size(); i++) {
+            if (Iter->Packets[i]->pos == Pos) {
+                Replay = Iter;
+                ReplayPos = i;
+                Replaying = true;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PacketCache::Next(AVPacket *Packet) {
+    if (!Replaying || ReplayPos >= Replay->Packets.size())
+        return false;
+    if (av_packet_ref(Packet, Replay->Packets[ReplayPos]) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference cached packet");
+    ++ReplayPos;
+    return true;
+}
+
+bool PacketCache::FinishReplay(const AVPacket *&First, const AVPacket *&Last) {
+    if (!Replaying)
+        return false;
+    Replaying = false;
+    if (HaveLive && Live == Replay)
+        return false;
+    // Nothing gets appended anywhere until the demuxer is back at the end of the replayed run
+    HaveLive = false;
+    First = Replay->Packets.front();
+    Last = Replay->Packets.back();
+    return true;
+}
+
+void PacketCache::ContinueRun() {
+    Live = Replay;
+    HaveLive = true;
+}
+
+void PacketCache::Clear() {
+    for (auto &Run : Runs) {
+        for (auto Packet : Run.Packets)
+            av_packet_free(&Packet);
+    }
+    Runs.clear();
+    HaveLive = false;
+    Replaying = false;
+    CurrentSize = 0;
+    Charge.Set(0);
+}
+
+bool SwsContextCache::Key::operator==(const Key &Other) const {
+    return SrcWidth == Other.SrcWidth && SrcHeight == Other.SrcHeight && SrcFormat == Other.SrcFormat &&
+        SrcColorSpace == Other.SrcColorSpace && SrcColorRange == Other.SrcColorRange &&
+        DstWidth == Other.DstWidth && DstHeight == Other.DstHeight && DstFormat == Other.DstFormat &&
+        DstColorSpace == Other.DstColorSpace && DstColorRange == Other.DstColorRange &&
+        Flags == Other.Flags && Threads == Other.Threads;
+}
+
+SwsContextCache::~SwsContextCache() {
+    Clear();
+}
+
+const SwsContextCache::Entry *SwsContextCache::Get(const Key &Params) {
+    for (auto Iter = Entries.begin(); Iter != Entries.end(); ++Iter) {
+        if (Iter->Params == Params) {
+            Entries.splice(Entries.begin(), Entries, Iter);
+            return &Entries.front();
+        }
+    }
+
+    SwsContext *Context = GetSwsContext(
+        Params.SrcWidth, Params.SrcHeight, Params.SrcFormat, Params.SrcColorSpace, Params.SrcColorRange,
+        Params.DstWidth, Params.DstHeight, Params.DstFormat, Params.DstColorSpace, Params.DstColorRange,
+        Params.Flags, Params.Threads);
+    if (!Context)
+        return nullptr;
+
+    AVBufferPool *Pool = nullptr;
+    int Size = av_image_get_buffer_size(Params.DstFormat, Params.DstWidth, Params.DstHeight, 4);
+    if (Size >= 0)
+        Pool = av_buffer_pool_init(Size, nullptr);
+    if (!Pool) {
+        sws_freeContext(Context);
+        throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not allocate frame with new resolution.");
+    }
+
+    // The entry in use is always at the front so it's never the one evicted
+    while (!Entries.empty() && Entries.size() >= MaxEntries) {
+        sws_freeContext(Entries.back().Context);
+        // Buffers still referenced by frames keep the pool alive until they're released
+        av_buffer_pool_uninit(&Entries.back().Pool);
+        Entries.pop_back();
+    }
+
+    Entries.push_front({ Params, Context, Pool });
+    return &Entries.front();
+}
+
+void SwsContextCache::Clear() {
+    for (auto &Entry : Entries) {
+        sws_freeContext(Entry.Context);
+        av_buffer_pool_uninit(&Entry.Pool);
+    }
+    Entries.clear();
+}
+
 
 void FFMS_VideoSource::SanityCheckFrameForData(AVFrame *Frame) {
     for (int i = 0; i < 4; i++) {
@@ -67,6 +379,7 @@ void FFMS_VideoSource::GetFrameCheck(int n) {
 }
 
 FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
+    TraceSpan Span("video", "OutputFrame");
     SanityCheckFrameForData(Frame);
 
     if (LastFrameWidth != Frame->width || LastFrameHeight != Frame->height || LastFramePixelFormat != Frame->format) {
@@ -84,10 +397,22 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
     }
 
     if (SWS) {
-        sws_scale(SWS, Frame->data, Frame->linesize, 0, Frame->height, SWSFrameData, SWSFrameLinesize);
+        uint8_t * const *Dst = SWSFrameData;
+        const int *DstLinesize = SWSFrameLinesize;
+        AVBufferRef *DstBuffer = nullptr;
+        if (OutputTarget) {
+            Dst = OutputTarget;
+            DstLinesize = OutputTargetLinesize;
+        } else {
+            // Someone holds a reference to the previous output, so leave it alone
+            if (!av_buffer_is_writable(SWSBuffer))
+                NextSWSBuffer();
+            DstBuffer = SWSBuffer;
+        }
+        ConvertFrame(Frame, Dst, DstLinesize, DstBuffer);
         for (int i = 0; i < 4; i++) {
-            LocalFrame.Data[i] = SWSFrameData[i];
-            LocalFrame.Linesize[i] = SWSFrameLinesize[i];
+            LocalFrame.Data[i] = Dst[i];
+            LocalFrame.Linesize[i] = DstLinesize[i];
         }
     } else {
         // Special case to avoid ugly casts
@@ -100,20 +425,20 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
     if (IsLayered) {
         if ((PrimaryEyeIsLeft && !EyesInverted) || (!PrimaryEyeIsLeft && EyesInverted)) {
             for (int i = 0; i < 4; i++) {
-                LocalFrame.Data[i] = LeftEyeFrameData[i];
-                LocalFrame.Linesize[i] = LeftEyeLinesize[i];
+                LocalFrame.Data[i] = LeftEyeFrame->data[i];
+                LocalFrame.Linesize[i] = LeftEyeFrame->linesize[i];
             }
         } else {
             for (int i = 0; i < 4; i++) {
-                LocalFrame.Data[i] = RightEyeFrameData[i];
-                LocalFrame.Linesize[i] = RightEyeLinesize[i];
+                LocalFrame.Data[i] = RightEyeFrame->data[i];
+                LocalFrame.Linesize[i] = RightEyeFrame->linesize[i];
             }
         }
         for (int i = 0; i < 4; i++) {
-            LocalFrame.LeftEyeData[i] = LeftEyeFrameData[i];
-            LocalFrame.LeftEyeLinesize[i] = LeftEyeLinesize[i];
-            LocalFrame.RightEyeData[i] = RightEyeFrameData[i];
-            LocalFrame.RightEyeLinesize[i] = RightEyeLinesize[i];
+            LocalFrame.LeftEyeData[i] = LeftEyeFrame->data[i];
+            LocalFrame.LeftEyeLinesize[i] = LeftEyeFrame->linesize[i];
+            LocalFrame.RightEyeData[i] = RightEyeFrame->data[i];
+            LocalFrame.RightEyeLinesize[i] = RightEyeFrame->linesize[i];
         }
         if (EyesInverted) {
             for (int i = 0; i < 4; i++) {
@@ -123,6 +448,16 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
         }
     }
 
+    // Nothing to convert so the caller's planes get a plain copy
+    if (OutputTarget && !SWS) {
+        av_image_copy(OutputTarget, OutputTargetLinesize, LocalFrame.Data, LocalFrame.Linesize, (AVPixelFormat) Frame->format, Frame->width, Frame->height);
+        for (int i = 0; i < 4; i++) {
+            LocalFrame.Data[i] = OutputTarget[i];
+            LocalFrame.Linesize[i] = OutputTargetLinesize[i];
+        }
+    }
+    LocalFrameIsExternal = !!OutputTarget;
+
     LocalFrame.EncodedWidth = Frame->width;
     LocalFrame.EncodedHeight = Frame->height;
     LocalFrame.EncodedPixelFormat = Frame->format;
@@ -140,7 +475,8 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
     LocalFrame.TransferCharateristics = (OutputTransferCharateristics >= 0) ? OutputTransferCharateristics : Frame->color_trc;
     LocalFrame.ChromaLocation = (OutputChromaLocation >= 0) ? OutputChromaLocation : Frame->chroma_location;
 
-    const AVFrameSideData *MasteringDisplaySideData = av_frame_get_side_data(Frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
+    ScopedStatTimer MetadataTimer(Stats.MetadataTime);
+    const AVFrameSideData *MasteringDisplaySideData = (MetadataExport & FFMS_METADATA_MASTERING_DISPLAY) ? av_frame_get_side_data(Frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) : nullptr;
     if (MasteringDisplaySideData) {
         const AVMasteringDisplayMetadata *MasteringDisplay = reinterpret_cast<const AVMasteringDisplayMetadata *>(MasteringDisplaySideData->data);
         if (MasteringDisplay->has_primaries) {
@@ -157,6 +493,15 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
             LocalFrame.MasteringDisplayMinLuminance = av_q2d(MasteringDisplay->min_luminance);
             LocalFrame.MasteringDisplayMaxLuminance = av_q2d(MasteringDisplay->max_luminance);
         }
+    } else if (!(MetadataExport & FFMS_METADATA_MASTERING_DISPLAY)) {
+        for (int i = 0; i < 3; i++) {
+            LocalFrame.MasteringDisplayPrimariesX[i] = 0;
+            LocalFrame.MasteringDisplayPrimariesY[i] = 0;
+        }
+        LocalFrame.MasteringDisplayWhitePointX = 0;
+        LocalFrame.MasteringDisplayWhitePointY = 0;
+        LocalFrame.MasteringDisplayMinLuminance = 0;
+        LocalFrame.MasteringDisplayMaxLuminance = 0;
     }
     LocalFrame.HasMasteringDisplayPrimaries = !!LocalFrame.MasteringDisplayPrimariesX[0] && !!LocalFrame.MasteringDisplayPrimariesY[0] &&
                                               !!LocalFrame.MasteringDisplayPrimariesX[1] && !!LocalFrame.MasteringDisplayPrimariesY[1] &&
@@ -165,7 +510,7 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
     /* MasteringDisplayMinLuminance can be 0 */
     LocalFrame.HasMasteringDisplayLuminance = !!LocalFrame.MasteringDisplayMaxLuminance;
 
-    const AVFrameSideData *DolbyVisionRPUSideData = av_frame_get_side_data(Frame, AV_FRAME_DATA_DOVI_RPU_BUFFER);
+    const AVFrameSideData *DolbyVisionRPUSideData = (MetadataExport & FFMS_METADATA_DOLBY_VISION_RPU) ? av_frame_get_side_data(Frame, AV_FRAME_DATA_DOVI_RPU_BUFFER) : nullptr;
     if (DolbyVisionRPUSideData) {
         if (DolbyVisionRPUSideData->size > RPUBufferSize) {
             void *tmp = av_realloc(RPUBuffer, DolbyVisionRPUSideData->size);
@@ -180,40 +525,48 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
 
         LocalFrame.DolbyVisionRPU = RPUBuffer;
         LocalFrame.DolbyVisionRPUSize = DolbyVisionRPUSideData->size;
+    } else if (!(MetadataExport & FFMS_METADATA_DOLBY_VISION_RPU)) {
+        LocalFrame.DolbyVisionRPU = nullptr;
+        LocalFrame.DolbyVisionRPUSize = 0;
     }
 
-    AVFrameSideData *HDR10PlusSideData = av_frame_get_side_data(Frame, AV_FRAME_DATA_DYNAMIC_HDR_PLUS);
+    AVFrameSideData *HDR10PlusSideData = (MetadataExport & FFMS_METADATA_HDR10PLUS) ? av_frame_get_side_data(Frame, AV_FRAME_DATA_DYNAMIC_HDR_PLUS) : nullptr;
     if (HDR10PlusSideData) {
-        uint8_t *T35Buffer = nullptr;
-        size_t T35Size;
-        int ret = av_dynamic_hdr_plus_to_t35(reinterpret_cast<const AVDynamicHDRPlus *>(HDR10PlusSideData->data), &T35Buffer, &T35Size);
-        if (ret < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
-                                     "HDR10+ dynamic metadata could not be serialized.");
-        if (T35Size > HDR10PlusBufferSize) {
-            void *tmp = av_realloc(HDR10PlusBuffer, T35Size);
-            if (!tmp)
+        // The serialized payload is attached to the frame so cached and repeatedly output frames only serialize it once
+        if (!Frame->opaque_ref) {
+            uint8_t *T35Buffer = nullptr;
+            size_t T35Size;
+            int ret = av_dynamic_hdr_plus_to_t35(reinterpret_cast<const AVDynamicHDRPlus *>(HDR10PlusSideData->data), &T35Buffer, &T35Size);
+            if (ret < 0)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+                                         "HDR10+ dynamic metadata could not be serialized.");
+            Frame->opaque_ref = av_buffer_create(T35Buffer, T35Size, nullptr, nullptr, 0);
+            if (!Frame->opaque_ref) {
+                av_free(T35Buffer);
                 throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
                                      "Could not allocate HDR10+ buffer.");
-            HDR10PlusBuffer = reinterpret_cast<uint8_t *>(tmp);
-            HDR10PlusBufferSize = T35Size;
+            }
         }
 
-        memcpy(HDR10PlusBuffer, T35Buffer, T35Size);
-        av_free(T35Buffer);
-
-        LocalFrame.HDR10Plus = HDR10PlusBuffer;
-        LocalFrame.HDR10PlusSize = T35Size;
+        LocalFrame.HDR10Plus = Frame->opaque_ref->data;
+        LocalFrame.HDR10PlusSize = Frame->opaque_ref->size;
+    } else if (!(MetadataExport & FFMS_METADATA_HDR10PLUS)) {
+        LocalFrame.HDR10Plus = nullptr;
+        LocalFrame.HDR10PlusSize = 0;
     }
 
-    const AVFrameSideData *ContentLightSideData = av_frame_get_side_data(Frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+    const AVFrameSideData *ContentLightSideData = (MetadataExport & FFMS_METADATA_CONTENT_LIGHT_LEVEL) ? av_frame_get_side_data(Frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) : nullptr;
     if (ContentLightSideData) {
         const AVContentLightMetadata *ContentLightLevel = reinterpret_cast<const AVContentLightMetadata *>(ContentLightSideData->data);
         LocalFrame.ContentLightLevelMax = ContentLightLevel->MaxCLL;
         LocalFrame.ContentLightLevelAverage = ContentLightLevel->MaxFALL;
+    } else if (!(MetadataExport & FFMS_METADATA_CONTENT_LIGHT_LEVEL)) {
+        LocalFrame.ContentLightLevelMax = 0;
+        LocalFrame.ContentLightLevelAverage = 0;
     }
     /* Only check for either of them */
     LocalFrame.HasContentLightLevel = !!LocalFrame.ContentLightLevelMax || !!LocalFrame.ContentLightLevelAverage;
+    MetadataTimer.Stop();
 
     LastFrameHeight = Frame->height;
     LastFrameWidth = Frame->width;
@@ -222,10 +575,153 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
     return &LocalFrame;
 }
 
-FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, int Track, int Threads, int SeekMode)
-    : Index(Index), SeekMode(SeekMode) {
+static void KeepExternalBuffer(void *, uint8_t *) {
+}
+
+void FFMS_VideoSource::ConvertFrame(AVFrame *Frame, uint8_t * const *Dst, const int *DstLinesize, AVBufferRef *DstBuffer) {
+    TraceSpan Span("video", "ConvertFrame");
+    ScopedStatTimer Timer(Stats.ConvertTime);
+    if (ConversionThreads == 1) {
+        sws_scale(SWS, Frame->data, Frame->linesize, 0, Frame->height, Dst, DstLinesize);
+        return;
+    }
+
+    // Threaded conversion is only available through the frame based API, which wants
+    // refcounted destination buffers, so memory that isn't ours gets a dummy reference
+    av_frame_unref(ConversionFrame);
+    ConversionFrame->width = TargetWidth;
+    ConversionFrame->height = TargetHeight;
+    ConversionFrame->format = OutputFormat;
+    for (int i = 0; i < 4; i++) {
+        ConversionFrame->data[i] = Dst[i];
+        ConversionFrame->linesize[i] = DstLinesize[i];
+    }
+    ConversionFrame->buf[0] = DstBuffer ? av_buffer_ref(DstBuffer) : av_buffer_create(Dst[0], 0, KeepExternalBuffer, nullptr, 0);
+    if (!ConversionFrame->buf[0])
+        throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference conversion output");
+
+    int Ret = sws_scale_frame(SWS, ConversionFrame, Frame);
+    av_frame_unref(ConversionFrame);
+    if (Ret < 0)
+        throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_UNKNOWN,
+            "Conversion failed: " + AVErrorToString(Ret));
+}
+
+void FFMS_VideoSource::OpenDecoder(bool ShareDemuxer) {
+    DecodeFrame = av_frame_alloc();
+    LastDecodedFrame = av_frame_alloc();
+    ConversionFrame = av_frame_alloc();
+    LeftEyeFrame = av_frame_alloc();
+    RightEyeFrame = av_frame_alloc();
+
+    if (!DecodeFrame || !LastDecodedFrame || !ConversionFrame || !LeftEyeFrame || !RightEyeFrame)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not allocate dummy frame.");
+
+    Demuxer.Open(SourceFile, Reader, VideoTrack, LAVFOpts, ShareDemuxer);
+    FormatContext = Demuxer.GetFormatContext();
+    OpenCodec();
+
+    SeekByPos = !strcmp(FormatContext->iformat->name, "mpeg") || !strcmp(FormatContext->iformat->name, "mpegts") || !strcmp(FormatContext->iformat->name, "mpegtsraw");
+
+    // Always try to decode a frame to make sure all required parameters are known
+    DecodeNextFrame();
+}
+
+void FFMS_VideoSource::OpenCodec() {
+    auto *Codec = avcodec_find_decoder(FormatContext->streams[VideoTrack]->codecpar->codec_id);
+    if (Codec == nullptr)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Video codec not found");
+
+    CodecContext = avcodec_alloc_context3(Codec);
+    if (CodecContext == nullptr)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not allocate video codec context.");
+    if (avcodec_parameters_to_context(CodecContext, FormatContext->streams[VideoTrack]->codecpar) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Could not copy video decoder parameters.");
+    CodecContext->thread_count = DecodingThreads;
+    // Slice threads add no delay so every seek gets cheaper, at the cost of less parallelism for most codecs
+    if (SliceThreading)
+        CodecContext->thread_type = FF_THREAD_SLICE;
+    CodecContext->has_b_frames = Frames.MaxBFrames;
+
+    // Full explanation by more clever person availale here: https://github.com/Nevcairiel/LAVFilters/issues/113
+    if (CodecContext->codec_id == AV_CODEC_ID_H264 && CodecContext->has_b_frames)
+        CodecContext->has_b_frames = 15; // the maximum possible value for h264
+
+    // Decoders simply ignore the shortcuts they don't implement
+    if (DecodeProfile != FFMS_DECODE_EXACT) {
+        CodecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+        CodecContext->skip_loop_filter = AVDISCARD_NONREF;
+    }
+    if (DecodeProfile == FFMS_DECODE_PREVIEW) {
+        CodecContext->skip_loop_filter = AVDISCARD_ALL;
+        CodecContext->skip_idct = AVDISCARD_NONREF;
+        CodecContext->lowres = std::min(1, static_cast<int>(Codec->max_lowres));
+    }
+
+    // Are we layered? Only a stream decoded to two views gets treated as such, a single view is just regular video.
+    if ((FormatContext->streams[VideoTrack]->disposition & AV_DISPOSITION_MULTILAYER) && Views == FFMS_VIEWS_ALL) {
+        IsLayered = true;
+        // See if we can figure out the primary (base) eye based on side data
+        for (int i = 0; i < FormatContext->streams[VideoTrack]->codecpar->nb_coded_side_data; i++) {
+            if (FormatContext->streams[VideoTrack]->codecpar->coded_side_data[i].type == AV_PKT_DATA_STEREO3D) {
+                const AVStereo3D *StereoSideData = (const AVStereo3D *)FormatContext->streams[VideoTrack]->codecpar->coded_side_data[i].data;
+                // If 'right', set it as such, otherwise it is left.
+                PrimaryEyeIsLeft = !(StereoSideData->primary_eye == AV_PRIMARY_EYE_RIGHT);
+                EyesInverted = !!(StereoSideData->flags & AV_STEREO3D_FLAG_INVERT);
+            }
+        }
+    }
+
+    // Just ask for all views possible if we're layered, the decoder defaults to only outputting (and decoding) the base view
+    AVDictionary *CodecDict = nullptr;
+    if (IsLayered)
+        av_dict_set(&CodecDict, "view_ids", "-1", 0);
+    else if (Views >= 0 && (FormatContext->streams[VideoTrack]->disposition & AV_DISPOSITION_MULTILAYER))
+        av_dict_set_int(&CodecDict, "view_ids", Views, 0);
+
+    if (avcodec_open2(CodecContext, Codec, &CodecDict) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Could not open video codec");
+
+    av_dict_free(&CodecDict);
+
+    // Similar yet different to h264 workaround above
+    // vc1 simply sets has_b_frames to 1 no matter how many there are so instead we set it to the max value
+    // in order to not confuse our own delay guesses later
+    // Doesn't affect actual vc1 reordering unlike h264
+    Delay.ThreadDelay = 0;
+    if (CodecContext->codec_id == AV_CODEC_ID_VC1 && CodecContext->has_b_frames) {
+        Delay.ReorderDelay = 7;     // the maximum possible value for vc1
+        Delay.ThreadDelay = CodecContext->thread_count - 1;
+    } else if (CodecContext->codec_id == AV_CODEC_ID_AV1) {
+        // libdav1d.c exports delay like this.
+        Delay.ReorderDelay = CodecContext->delay;
+    } else {
+        // In theory we can move this to CodecContext->delay, sort of, one day, maybe. Not now.
+        Delay.ReorderDelay = CodecContext->has_b_frames; // Normal decoder delay
+        if (CodecContext->active_thread_type & FF_THREAD_FRAME) // Adjust for frame based threading
+            Delay.ThreadDelay = CodecContext->thread_count - 1;
+    }
+
+    // Every frame in flight plus the reference frames, h264 and hevc need at most 16 of those
+    int FrameSize = av_image_get_buffer_size(CodecContext->pix_fmt, CodecContext->coded_width, CodecContext->coded_height, 1);
+    int64_t LiveFrames = Delay.ThreadDelay + Delay.ReorderDelay + 16;
+    DecoderMemory.Set(FrameSize > 0 ? FrameSize * LiveFrames : 0);
+}
+
+FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, int Track, int Threads, int SeekMode, int Views, const std::shared_ptr<InputReader> &Reader)
+    : SourceFile(SourceFile), Reader(Reader), LAVFOpts(Index.LAVFOpts), SeekMode(SeekMode), Views(Views) {
 
     try {
+        if (Views < FFMS_VIEWS_PRIMARY)
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+                "Invalid view selection");
+
         if (Track < 0 || Track >= static_cast<int>(Index.size()))
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_INVALID_ARGUMENT,
                 "Out of bounds track index selected");
@@ -238,7 +734,11 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_INVALID_ARGUMENT,
                 "Video track contains no frames");
 
-        if (!Index.CompareFileSignature(SourceFile))
+        // Linear access only ever reads forward, everything else jumps around the file
+        if (!this->Reader)
+            this->Reader = OpenFileReader(SourceFile, SeekMode > 0 ? AccessPattern::RANDOM : AccessPattern::SEQUENTIAL);
+
+        if (!Index.CompareFileSignature(SourceFile, this->Reader))
             throw FFMS_Exception(FFMS_ERROR_INDEX, FFMS_ERROR_FILE_MISMATCH,
                 "The index does not match the source file");
 
@@ -249,86 +749,10 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
             DecodingThreads = (std::min)(std::thread::hardware_concurrency(), 16u);
         else
             DecodingThreads = Threads;
+        // Sources opened when memory is already scarce make do with fewer frame threads
+        DecodingThreads = MemoryGovernor::Instance().LimitThreads(DecodingThreads);
 
-        DecodeFrame = av_frame_alloc();
-        LastDecodedFrame = av_frame_alloc();
-
-        if (!DecodeFrame || !LastDecodedFrame)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                "Could not allocate dummy frame.");
-
-        // Dummy allocations so the unallocated case doesn't have to be handled later
-        if (av_image_alloc(SWSFrameData, SWSFrameLinesize, 16, 16, AV_PIX_FMT_GRAY8, 4) < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                "Could not allocate dummy frame.");
-
-        LAVFOpenFile(SourceFile, FormatContext, VideoTrack, Index.LAVFOpts);
-
-        auto *Codec = avcodec_find_decoder(FormatContext->streams[VideoTrack]->codecpar->codec_id);
-        if (Codec == nullptr)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Video codec not found");
-
-        CodecContext = avcodec_alloc_context3(Codec);
-        if (CodecContext == nullptr)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                "Could not allocate video codec context.");
-        if (avcodec_parameters_to_context(CodecContext, FormatContext->streams[VideoTrack]->codecpar) < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Could not copy video decoder parameters.");
-        CodecContext->thread_count = DecodingThreads;
-        CodecContext->has_b_frames = Frames.MaxBFrames;
-
-        // Full explanation by more clever person availale here: https://github.com/Nevcairiel/LAVFilters/issues/113
-        if (CodecContext->codec_id == AV_CODEC_ID_H264 && CodecContext->has_b_frames)
-            CodecContext->has_b_frames = 15; // the maximum possible value for h264
-
-        // Are we layered?
-        if (FormatContext->streams[VideoTrack]->disposition & AV_DISPOSITION_MULTILAYER) {
-            IsLayered = true;
-            // See if we can figure out the primary (base) eye based on side data
-            for (int i = 0; i < FormatContext->streams[VideoTrack]->codecpar->nb_coded_side_data; i++) {
-                if (FormatContext->streams[VideoTrack]->codecpar->coded_side_data[i].type == AV_PKT_DATA_STEREO3D) {
-                    const AVStereo3D *StereoSideData = (const AVStereo3D *)FormatContext->streams[VideoTrack]->codecpar->coded_side_data[i].data;
-                    // If 'right', set it as such, otherwise it is left.
-                    PrimaryEyeIsLeft = !(StereoSideData->primary_eye == AV_PRIMARY_EYE_RIGHT);
-                    EyesInverted = !!(StereoSideData->flags & AV_STEREO3D_FLAG_INVERT);
-                }
-            }
-        }
-
-        // Just ask for all views possible if we're layered
-        AVDictionary *CodecDict = nullptr;
-        if (IsLayered)
-            av_dict_set(&CodecDict, "view_ids", "-1", 0);
-
-        if (avcodec_open2(CodecContext, Codec, &CodecDict) < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Could not open video codec");
-
-        av_dict_free(&CodecDict);
-
-        // Similar yet different to h264 workaround above
-        // vc1 simply sets has_b_frames to 1 no matter how many there are so instead we set it to the max value
-        // in order to not confuse our own delay guesses later
-        // Doesn't affect actual vc1 reordering unlike h264
-        if (CodecContext->codec_id == AV_CODEC_ID_VC1 && CodecContext->has_b_frames) {
-            Delay.ReorderDelay = 7;     // the maximum possible value for vc1
-            Delay.ThreadDelay = CodecContext->thread_count - 1;
-        } else if (CodecContext->codec_id == AV_CODEC_ID_AV1) {
-            // libdav1d.c exports delay like this.
-            Delay.ReorderDelay = CodecContext->delay;
-        } else {
-            // In theory we can move this to CodecContext->delay, sort of, one day, maybe. Not now.
-            Delay.ReorderDelay = CodecContext->has_b_frames; // Normal decoder delay
-            if (CodecContext->active_thread_type & FF_THREAD_FRAME) // Adjust for frame based threading
-                Delay.ThreadDelay = CodecContext->thread_count - 1;
-        }
-
-        SeekByPos = !strcmp(FormatContext->iformat->name, "mpeg") || !strcmp(FormatContext->iformat->name, "mpegts") || !strcmp(FormatContext->iformat->name, "mpegtsraw");
-
-        // Always try to decode a frame to make sure all required parameters are known
-        DecodeNextFrame();
+        OpenDecoder(DemuxerSharing);
 
         //VP.image_type = VideoInfo::IT_TFF;
         VP.FPSDenominator = FormatContext->streams[VideoTrack]->time_base.num;
@@ -489,15 +913,72 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
     }
 }
 
+FFMS_VideoSource::FFMS_VideoSource(const FFMS_VideoSource *Parent)
+    : ConversionThreads(Parent->ConversionThreads), SourceFile(Parent->SourceFile), Reader(Parent->Reader), LAVFOpts(Parent->LAVFOpts), Frames(Parent->Frames),
+    VideoTrack(Parent->VideoTrack), DecodingThreads(Parent->DecodingThreads), SeekMode(Parent->SeekMode), Views(Parent->Views),
+    DecodeProfile(Parent->DecodeProfile), ThreadingMode(Parent->ThreadingMode), SliceThreading(Parent->SliceThreading) {
+
+    try {
+        // Pool members exist to decode elsewhere in the file so sharing would only slow the others down
+        OpenDecoder(false);
+
+        // Everything else about the stream is already known
+        VP = Parent->VP;
+        MetadataExport = Parent->MetadataExport;
+        if (Parent->InputFormatOverridden) {
+            InputFormatOverridden = true;
+            InputFormat = Parent->InputFormat;
+            InputColorSpace = Parent->InputColorSpace;
+            InputColorRange = Parent->InputColorRange;
+        }
+        DetectInputFormat();
+        OutputFormat = InputFormat;
+        OutputColorSpace = InputColorSpace;
+        OutputColorRange = InputColorRange;
+
+        if (SeekMode >= 0 && Frames.size() > 1) {
+            if (Seek(0) < 0) {
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+                    "Video track is unseekable");
+            }
+        }
+
+        if (SeekMode < 0)
+            Stage = DecodeStage::INITIALIZE;
+
+        if (!Parent->TargetPixelFormats.empty()) {
+            std::vector<AVPixelFormat> TargetFormats(Parent->TargetPixelFormats);
+            TargetFormats.push_back(AV_PIX_FMT_NONE);
+            SetOutputFormat(TargetFormats.data(), Parent->TargetWidth, Parent->TargetHeight, Parent->TargetResizer);
+        } else {
+            OutputFrame(DecodeFrame);
+        }
+
+        FrameCache.SetMaxSize(Parent->FrameCache.GetMaxSize());
+        Packets.SetMaxSize(Parent->Packets.GetMaxSize());
+    } catch (FFMS_Exception &) {
+        Free();
+        throw;
+    }
+}
+
 FFMS_VideoSource::~FFMS_VideoSource() {
+    StopPrefetchThread();
     Free();
 }
 
-FFMS_Frame *FFMS_VideoSource::GetFrameByTime(double Time) {
+int FFMS_VideoSource::GetFrameNumberFromTime(double Time) {
     // The final 1/1000th of a PTS is added to avoid frame duplication due to floating point math inexactness
     // Basically only a problem when the fps is externally set to the same or a multiple of the input clip fps
-    int Frame = Frames.ClosestFrameFromPTS(static_cast<int64_t>(((Time * 1000 * Frames.TB.Den) / Frames.TB.Num) + .001));
-    return GetFrame(Frame);
+    return Frames.ClosestFrameFromPTS(static_cast<int64_t>(((Time * 1000 * Frames.TB.Den) / Frames.TB.Num) + .001));
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFrameByTime(double Time) {
+    return GetFrame(GetFrameNumberFromTime(Time));
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFrameByTimeInto(double Time, uint8_t * const *DstData, const int *DstLinesize) {
+    return GetFrameInto(GetFrameNumberFromTime(Time), DstData, DstLinesize);
 }
 
 static AVColorRange handle_jpeg(AVPixelFormat *format) {
@@ -511,21 +992,28 @@ static AVColorRange handle_jpeg(AVPixelFormat *format) {
 }
 
 void FFMS_VideoSource::SetOutputFormat(const AVPixelFormat *TargetFormats, int Width, int Height, int Resizer) {
+    PausePrefetch();
+
     TargetWidth = Width;
     TargetHeight = Height;
     TargetResizer = Resizer;
     TargetPixelFormats.clear();
-    while (*TargetFormats != AV_PIX_FMT_NONE)
-        TargetPixelFormats.push_back(*TargetFormats++);
+    for (const AVPixelFormat *Format = TargetFormats; *Format != AV_PIX_FMT_NONE; Format++)
+        TargetPixelFormats.push_back(*Format);
     OutputColorSpaceSet = true;
     OutputColorRangeSet = true;
     OutputFormat = AV_PIX_FMT_NONE;
 
     ReAdjustOutputFormat(DecodeFrame);
     OutputFrame(DecodeFrame);
+
+    for (auto &Member : PoolMembers)
+        Member->SetOutputFormat(TargetFormats, Width, Height, Resizer);
 }
 
 void FFMS_VideoSource::SetInputFormat(int ColorSpace, int ColorRange, AVPixelFormat Format) {
+    PausePrefetch();
+
     InputFormatOverridden = true;
 
     if (Format != AV_PIX_FMT_NONE)
@@ -539,6 +1027,9 @@ void FFMS_VideoSource::SetInputFormat(int ColorSpace, int ColorRange, AVPixelFor
         ReAdjustOutputFormat(DecodeFrame);
         OutputFrame(DecodeFrame);
     }
+
+    for (auto &Member : PoolMembers)
+        Member->SetInputFormat(ColorSpace, ColorRange, Format);
 }
 
 void FFMS_VideoSource::DetectInputFormat() {
@@ -557,10 +1048,7 @@ void FFMS_VideoSource::DetectInputFormat() {
 }
 
 void FFMS_VideoSource::ReAdjustOutputFormat(AVFrame *Frame) {
-    if (SWS) {
-        sws_freeContext(SWS);
-        SWS = nullptr;
-    }
+    SWS = nullptr;
 
     DetectInputFormat();
 
@@ -615,29 +1103,53 @@ void FFMS_VideoSource::ReAdjustOutputFormat(AVFrame *Frame) {
         TargetHeight != CodecContext->height ||
         InputColorSpace != OutputColorSpace ||
         InputColorRange != OutputColorRange) {
-        SWS = GetSwsContext(
+        const SwsContextCache::Entry *Conversion = ConversionCache.Get({
             Frame->width, Frame->height, InputFormat, InputColorSpace, InputColorRange,
             TargetWidth, TargetHeight, OutputFormat, OutputColorSpace, OutputColorRange,
-            TargetResizer);
+            TargetResizer, ConversionThreads });
 
-        if (!SWS) {
+        if (!Conversion) {
             ResetOutputFormat();
             throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_INVALID_ARGUMENT,
                 "Failed to allocate SWScale context");
         }
+
+        SWS = Conversion->Context;
+        UseSWSBufferPool(Conversion->Pool, TargetWidth, TargetHeight, OutputFormat);
+    } else {
+        UseSWSBufferPool(nullptr, 0, 0, AV_PIX_FMT_NONE);
     }
+}
+
+void FFMS_VideoSource::UseSWSBufferPool(AVBufferPool *Pool, int Width, int Height, AVPixelFormat Format) {
+    if (Pool == SWSBufferPool && Width == SWSBufferWidth && Height == SWSBufferHeight && Format == SWSBufferFormat)
+        return;
+
+    av_buffer_unref(&SWSBuffer);
+    SWSBufferPool = Pool;
+    SWSBufferWidth = Width;
+    SWSBufferHeight = Height;
+    SWSBufferFormat = Format;
+    if (SWSBufferPool)
+        NextSWSBuffer();
+}
 
-    av_freep(&SWSFrameData[0]);
-    if (av_image_alloc(SWSFrameData, SWSFrameLinesize, TargetWidth, TargetHeight, OutputFormat, 4) < 0)
+void FFMS_VideoSource::NextSWSBuffer() {
+    AVBufferRef *Buffer = av_buffer_pool_get(SWSBufferPool);
+    if (!Buffer)
         throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_ALLOCATION_FAILED,
             "Could not allocate frame with new resolution.");
+    av_buffer_unref(&SWSBuffer);
+    SWSBuffer = Buffer;
+    av_image_fill_arrays(SWSFrameData, SWSFrameLinesize, SWSBuffer->data, SWSBufferFormat, SWSBufferWidth, SWSBufferHeight, 4);
 }
 
 void FFMS_VideoSource::ResetOutputFormat() {
-    if (SWS) {
-        sws_freeContext(SWS);
-        SWS = nullptr;
-    }
+    PausePrefetch();
+
+    // The conversion stays cached in case the same output format gets set again
+    SWS = nullptr;
+    UseSWSBufferPool(nullptr, 0, 0, AV_PIX_FMT_NONE);
 
     TargetWidth = -1;
     TargetHeight = -1;
@@ -650,9 +1162,14 @@ void FFMS_VideoSource::ResetOutputFormat() {
     OutputColorRangeSet = false;
 
     OutputFrame(DecodeFrame);
+
+    for (auto &Member : PoolMembers)
+        Member->ResetOutputFormat();
 }
 
 void FFMS_VideoSource::ResetInputFormat() {
+    PausePrefetch();
+
     InputFormatOverridden = false;
     InputFormat = AV_PIX_FMT_NONE;
     InputColorSpace = AVCOL_SPC_UNSPECIFIED;
@@ -660,6 +1177,9 @@ void FFMS_VideoSource::ResetInputFormat() {
 
     ReAdjustOutputFormat(DecodeFrame);
     OutputFrame(DecodeFrame);
+
+    for (auto &Member : PoolMembers)
+        Member->ResetInputFormat();
 }
 
 void FFMS_VideoSource::SetVideoProperties() {
@@ -722,22 +1242,21 @@ bool FFMS_VideoSource::HasPendingDelayedFrames() {
     return false;
 }
 
-void FFMS_VideoSource::CopyEye(AVStereo3DView view) {
-    if (view == AV_STEREO3D_VIEW_LEFT) {
-        av_freep(&LeftEyeFrameData[0]);
-        if (av_image_alloc(LeftEyeFrameData, LeftEyeLinesize, DecodeFrame->width, DecodeFrame->height, (enum AVPixelFormat) DecodeFrame->format, 16) < 0)
-                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                    "Could not allocate left eye buffer");
-        av_image_copy(LeftEyeFrameData, LeftEyeLinesize, DecodeFrame->data, DecodeFrame->linesize, (enum AVPixelFormat) DecodeFrame->format, DecodeFrame->width, DecodeFrame->height);
-    } else if (view == AV_STEREO3D_VIEW_RIGHT) {
-        av_freep(&RightEyeFrameData[0]);
-        if (av_image_alloc(RightEyeFrameData, RightEyeLinesize, DecodeFrame->width, DecodeFrame->height, (enum AVPixelFormat) DecodeFrame->format, 16) < 0)
-                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                    "Could not allocate right eye buffer");
-        av_image_copy(RightEyeFrameData, RightEyeLinesize, DecodeFrame->data, DecodeFrame->linesize, (enum AVPixelFormat) DecodeFrame->format, DecodeFrame->width, DecodeFrame->height);
-    } else {
+void FFMS_VideoSource::ReferenceEye(AVStereo3DView view) {
+    AVFrame *Eye;
+    if (view == AV_STEREO3D_VIEW_LEFT)
+        Eye = LeftEyeFrame;
+    else if (view == AV_STEREO3D_VIEW_RIGHT)
+        Eye = RightEyeFrame;
+    else
         throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC, "Layered decode with invalid view.");
-    }
+
+    // The decoder hands out refcounted frames so keeping the view around costs nothing,
+    // the pixels only get copied if the frame is actually returned somewhere that needs it
+    av_frame_unref(Eye);
+    if (av_frame_ref(Eye, DecodeFrame) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference eye view");
 }
 
 bool FFMS_VideoSource::DecodePacket(const AVPacket &Packet) {
@@ -748,6 +1267,8 @@ bool FFMS_VideoSource::DecodePacket(const AVPacket &Packet) {
     bool PacketHidden = !!(Packet.flags & AV_PKT_FLAG_DISCARD) || (PacketNum != -1 && Frames[PacketNum].MarkedHidden);
     bool SecondField = PacketNum != -1 && Frames[PacketNum].SecondField;
 
+    TraceSpan Span("video", "DecodePacket", PacketNum);
+    ScopedStatTimer Timer(Stats.DecodeTime);
     int Ret = avcodec_send_packet(CodecContext, &Packet);
     if (Ret == AVERROR(EAGAIN)) {
         // Send queue is full, so stash packet to resend on the next call.
@@ -766,7 +1287,7 @@ bool FFMS_VideoSource::DecodePacket(const AVPacket &Packet) {
 
             const AVStereo3D *stereo3d = (const AVStereo3D *)sd->data;
             AVStereo3DView first_view = stereo3d->view;
-            CopyEye(stereo3d->view);
+            ReferenceEye(stereo3d->view);
 
             Ret = avcodec_receive_frame(CodecContext, DecodeFrame);
             if (Ret != 0)
@@ -783,9 +1304,10 @@ bool FFMS_VideoSource::DecodePacket(const AVPacket &Packet) {
                 (first_view == AV_STEREO3D_VIEW_RIGHT && stereo3d->view != AV_STEREO3D_VIEW_LEFT)) {
                 throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC, "Unmatched left/right views in layered decode.");
             }
-            CopyEye(stereo3d->view);
+            ReferenceEye(stereo3d->view);
         }
         Delay.Decrement();
+        ++Stats.FramesDecoded;
     } else {
         std::swap(DecodeFrame, LastDecodedFrame);
     }
@@ -797,21 +1319,34 @@ bool FFMS_VideoSource::DecodePacket(const AVPacket &Packet) {
 }
 
 int FFMS_VideoSource::Seek(int n) {
+    TraceSpan Span("video", "Seek", n);
     int ret = -1;
 
     Delay.Reset();
     if (Stage != DecodeStage::INITIALIZE_SOURCE)
         Stage = DecodeStage::INITIALIZE;
 
-    if (!SeekByPos || Frames[n].FilePos < 0) {
-        ret = av_seek_frame(FormatContext, VideoTrack, Frames[n].PTS, AVSEEK_FLAG_BACKWARD);
-    }
+    // A keyframe is a valid place for a seek to land so the packets can simply be replayed from there
+    if (Frames[n].KeyFrame && Packets.Seek(Frames[n].FilePos)) {
+        ret = 0;
+        ++Stats.CachedSeeks;
+    } else {
+        if (!SeekByPos || Frames[n].FilePos < 0) {
+            ret = Demuxer.Seek(Frames[n].PTS, AVSEEK_FLAG_BACKWARD);
+        }
+
+        if (ret < 0 && Frames[n].FilePos >= 0) {
+            ret = Demuxer.Seek(Frames[n].FilePos, AVSEEK_FLAG_BYTE);
+            if (ret >= 0)
+                SeekByPos = true;
+        }
 
-    if (ret < 0 && Frames[n].FilePos >= 0) {
-        ret = av_seek_frame(FormatContext, VideoTrack, Frames[n].FilePos, AVSEEK_FLAG_BYTE);
-        if (ret >= 0)
-            SeekByPos = true;
+        ++Stats.Seeks;
+        if (ret < 0)
+            ++Stats.FailedSeeks;
+        Packets.StartRun();
     }
+    LastRawPacket = -1;
 
     // We always assume seeking is possible if the first seek succeeds
     avcodec_flush_buffers(CodecContext);
@@ -825,18 +1360,75 @@ int FFMS_VideoSource::Seek(int n) {
     return ret;
 }
 
+int FFMS_VideoSource::ReadPacket(AVPacket *Packet) {
+    TraceSpan Span("video", "ReadPacket");
+    if (Packets.IsReplaying()) {
+        if (Packets.Next(Packet)) {
+            ++Stats.CachedPackets;
+            return 0;
+        }
+        ResumeAfterReplay();
+    }
+
+    ScopedStatTimer Timer(Stats.DemuxTime);
+    int ret = Demuxer.Read(Packet);
+    if (ret >= 0) {
+        ++Stats.PacketsRead;
+        Stats.BytesRead += Packet->size;
+        Packets.Add(Packet);
+    }
+    return ret;
+}
+
+void FFMS_VideoSource::ResumeAfterReplay() {
+    const AVPacket *First, *Last;
+    if (!Packets.FinishReplay(First, Last))
+        return;
+
+    TraceSpan Span("video", "ResumeAfterReplay");
+    ScopedStatTimer Timer(Stats.DemuxTime);
+    int ret = -1;
+    if (!SeekByPos && First->pts != AV_NOPTS_VALUE)
+        ret = Demuxer.Seek(First->pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0 && First->pos >= 0)
+        ret = Demuxer.Seek(First->pos, AVSEEK_FLAG_BYTE);
+    ++Stats.Seeks;
+
+    // The seek lands at or before the start of the replayed run so everything up to its end gets skipped
+    SmartAVPacket Packet;
+    while (ret >= 0 && (ret = Demuxer.Read(Packet.get())) >= 0) {
+        ++Stats.PacketsRead;
+        Stats.BytesRead += Packet->size;
+        bool Match = Last->pos >= 0 ? Packet->pos == Last->pos : (Packet->pts == Last->pts && Packet->dts == Last->dts);
+        av_packet_unref(Packet.get());
+        if (Match) {
+            Packets.ContinueRun();
+            return;
+        }
+    }
+
+    ++Stats.FailedSeeks;
+    throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_UNKNOWN,
+        "Couldn't find the end of the cached packets in the file again");
+}
+
 void FFMS_VideoSource::Free() {
+    FrameCache.Clear();
+    Packets.Clear();
+    DecoderMemory.Set(0);
     av_freep(&RPUBuffer);
-    av_freep(&HDR10PlusBuffer);
     avcodec_free_context(&CodecContext);
-    avformat_close_input(&FormatContext);
-    if (SWS)
-        sws_freeContext(SWS);
-    av_freep(&SWSFrameData[0]);
-    av_freep(&LeftEyeFrameData[0]);
-    av_freep(&RightEyeFrameData[0]);
+    Demuxer.Close();
+    FormatContext = nullptr;
+    SWS = nullptr;
+    av_buffer_unref(&SWSBuffer);
+    SWSBufferPool = nullptr;
+    ConversionCache.Clear();
+    av_frame_free(&LeftEyeFrame);
+    av_frame_free(&RightEyeFrame);
     av_frame_free(&DecodeFrame);
     av_frame_free(&LastDecodedFrame);
+    av_frame_free(&ConversionFrame);
 }
 
 SmartAVPacket FFMS_VideoSource::DecodeNextFrame() {
@@ -853,12 +1445,12 @@ SmartAVPacket FFMS_VideoSource::DecodeNextFrame() {
         av_packet_ref(Packet.get(), StashedPacket.get());
         av_packet_unref(StashedPacket.get());
     } else {
-        ret = av_read_frame(FormatContext, Packet.get());
+        ret = ReadPacket(Packet.get());
     }
     while (ret >= 0) {
         if (Packet->stream_index != VideoTrack) {
             av_packet_unref(Packet.get());
-            ret = av_read_frame(FormatContext, Packet.get());
+            ret = ReadPacket(Packet.get());
             continue;
         }
 
@@ -878,7 +1470,7 @@ SmartAVPacket FFMS_VideoSource::DecodeNextFrame() {
             av_packet_ref(Packet.get(), StashedPacket.get());
             av_packet_unref(StashedPacket.get());
         } else {
-            ret = av_read_frame(FormatContext, Packet.get());
+            ret = ReadPacket(Packet.get());
         }
     }
     if (IsIOError(ret))
@@ -919,8 +1511,10 @@ bool FFMS_VideoSource::SeekTo(int n, int SeekOffset) {
                 Seek(Frames[0].OriginalPos);
             }
         } else {
-            // 10 frames is used as a margin to prevent excessive seeking since the predicted best keyframe isn't always selected by avformat
-            if (ForceSeek || n < CurrentFrame || TargetFrame > CurrentFrame + 10 || (SeekMode == 3 && n > CurrentFrame + 10)) {
+            // Only seek forward when the time saved by skipping ahead outweighs what the seek itself costs, the measured
+            // seek cost includes the extra decoding when avformat doesn't land on the predicted best keyframe
+            int SeekDistance = std::max(1, SeekCosts.SeekDistance());
+            if (ForceSeek || n < CurrentFrame || TargetFrame > CurrentFrame + SeekDistance || (SeekMode == 3 && n > CurrentFrame + SeekDistance)) {
                 Seek(TargetFrame);
                 return true;
             }
@@ -933,31 +1527,180 @@ bool FFMS_VideoSource::SeekTo(int n, int SeekOffset) {
 }
 
 FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
+    FFMS_Frame *Frame;
+    if (!PoolMembers.empty()) {
+        Frame = WithPooledDecoder(n, [this, n](FFMS_VideoSource *Decoder) -> FFMS_Frame * {
+            OwnedFrame *Output = GetPooledOutput();
+            Decoder->GetFrameInternal(n);
+            Decoder->CopyOutputFrame(*Output);
+            return &Output->Frame;
+        });
+    } else if (PrefetchSize > 0) {
+        Frame = GetFramePrefetched(n);
+    } else {
+        Frame = GetFrameInternal(n);
+    }
+    ++Stats.FramesReturned;
+    return Frame;
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFrameRef(int n) {
+    if (!PoolMembers.empty()) {
+        // The checked out decoder may be this source itself so it has to be used without going through the pool again
+        FFMS_Frame *Frame = WithPooledDecoder(n, [n](FFMS_VideoSource *Decoder) {
+            Decoder->GetFrameInternal(n);
+            return Decoder->CreateFrameRef();
+        });
+        ++Stats.FramesReturned;
+        return Frame;
+    }
+
+    if (PrefetchSize > 0) {
+        FFMS_Frame *Frame = GetFramePrefetched(n);
+        ++Stats.FramesReturned;
+        std::lock_guard<std::mutex> Lock(PrefetchMutex);
+        // A prefetched frame is already a private copy so it can simply be handed over
+        if (PrefetchOutput && Frame == &PrefetchOutput->Frame) {
+            PrefetchOutputFrame = -1;
+            return CreateFrameRef(std::move(PrefetchOutput));
+        }
+        return CreateFrameRef();
+    }
+
+    GetFrameInternal(n);
+    ++Stats.FramesReturned;
+    return CreateFrameRef();
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFrameInto(int n, uint8_t * const *DstData, const int *DstLinesize) {
+    // The eyes bypass the conversion so there's no telling whether they'd even fit into the caller's planes
+    if (IsLayered)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_UNSUPPORTED,
+            "Decoding into caller supplied planes isn't supported for layered sources");
+
+    if (!PoolMembers.empty()) {
+        // The checked out decoder may be this source itself so it has to be used without going through the pool again
+        FFMS_Frame *Frame = WithPooledDecoder(n, [this, n, DstData, DstLinesize](FFMS_VideoSource *Decoder) -> FFMS_Frame * {
+            OwnedFrame *Output = GetPooledOutput();
+            Decoder->GetFrameIntoInternal(n, DstData, DstLinesize);
+            Decoder->CopyFrameProperties(*Output);
+            return &Output->Frame;
+        });
+        ++Stats.FramesReturned;
+        return Frame;
+    }
+
+    if (PrefetchSize > 0) {
+        // The conversion has already happened by the time the frame is known, so all that's left is a copy
+        FFMS_Frame *Frame = GetFramePrefetched(n);
+        ++Stats.FramesReturned;
+        std::lock_guard<std::mutex> Lock(PrefetchMutex);
+        int Width, Height;
+        AVPixelFormat Format;
+        if (PrefetchOutput && Frame == &PrefetchOutput->Frame) {
+            Width = PrefetchOutput->Main.Width;
+            Height = PrefetchOutput->Main.Height;
+            Format = PrefetchOutput->Main.Format;
+        } else {
+            GetOutputGeometry(Width, Height, Format);
+        }
+        av_image_copy(DstData, DstLinesize, Frame->Data, Frame->Linesize, Format, Width, Height);
+        TargetFrame = *Frame;
+        for (int i = 0; i < 4; i++) {
+            TargetFrame.Data[i] = DstData[i];
+            TargetFrame.Linesize[i] = DstLinesize[i];
+        }
+        return &TargetFrame;
+    }
+
+    FFMS_Frame *Frame = GetFrameIntoInternal(n, DstData, DstLinesize);
+    ++Stats.FramesReturned;
+    return Frame;
+}
+
+// Decodes n straight into DstData on this decoder, the pool is never involved
+FFMS_Frame *FFMS_VideoSource::GetFrameIntoInternal(int n, uint8_t * const *DstData, const int *DstLinesize) {
+    OutputTarget = DstData;
+    OutputTargetLinesize = DstLinesize;
+    try {
+        GetFrameInternal(n);
+    } catch (FFMS_Exception &) {
+        OutputTarget = nullptr;
+        OutputTargetLinesize = nullptr;
+        throw;
+    }
+    OutputTarget = nullptr;
+    OutputTargetLinesize = nullptr;
+    return &LocalFrame;
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFrameInternal(int n) {
+    TraceSpan Span("video", "GetFrame", n);
     GetFrameCheck(n);
+    FrameCache.Shrink();
     n = Frames.RealFrameNumber(n);
 
-    if (Stage != DecodeStage::INITIALIZE_SOURCE && LastFrameNum == n)
+    if (Stage != DecodeStage::INITIALIZE_SOURCE && LastFrameNum == n) {
+        // Only redo the output step when the planes have to end up somewhere else
+        if (OutputTarget || LocalFrameIsExternal)
+            return OutputFrame(DecodeFrame);
         return &LocalFrame;
+    }
+
+    // Layered frames carry their eyes outside of the AVFrame so they can't be cached
+    if (!IsLayered) {
+        AVFrame *CachedFrame = FrameCache.Get(n);
+        if (CachedFrame) {
+            // Replace DecodeFrame so format changes keep operating on the returned frame,
+            // the decoder only ever writes to it after an unref so its position is unaffected
+            av_frame_unref(DecodeFrame);
+            if (av_frame_ref(DecodeFrame, CachedFrame) < 0)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not reference cached frame");
+            LastFrameNum = n;
+            return OutputFrame(DecodeFrame);
+        }
+    }
+
+    // Reopening forces a seek which says nothing about how the source is used
+    bool RecordAccess = !AdaptThreading();
 
     int SeekOffset = 0;
     bool Seek = true;
     bool WasSkipped = false;
+    bool AnySeek = false;
 
     do {
+        auto DecodeStart = std::chrono::steady_clock::now();
         bool HasSeeked = false;
         if (Seek) {
             HasSeeked = SeekTo(n, SeekOffset);
+            AnySeek |= HasSeeked;
             Seek = false;
             WasSkipped = false;
         }
 
+        // Frames still being flushed out after a seek cost next to nothing so only the regular decode loop is measured
+        bool MeasureFrame = !HasSeeked && Stage == DecodeStage::DECODE_LOOP;
+        bool Decoded = false;
+
         SmartAVPacket FirstPacket;
         bool Skipped = (((unsigned) CurrentFrame < Frames.size()) && Frames[CurrentFrame].Skipped());
         if (HasSeeked || !Skipped) {
-            if (WasSkipped)
+            if (WasSkipped) {
                 WasSkipped = false;
-            else
+            } else {
                 FirstPacket = DecodeNextFrame();
+                Decoded = true;
+            }
+        }
+
+        if (HasSeeked || (MeasureFrame && Decoded)) {
+            double Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - DecodeStart).count();
+            if (HasSeeked)
+                SeekCosts.AddSeek(Elapsed);
+            else
+                SeekCosts.AddFrame(Elapsed);
         }
 
         if (!HasSeeked)
@@ -970,6 +1713,7 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
         if (CurrentFrame < 0) {
             if (SeekMode == 1 || StartTime < 0) {
                 // No idea where we are so go back a bit further
+                ++Stats.FailedSeeks;
                 SeekOffset -= 10;
                 Seek = true;
                 continue;
@@ -1011,6 +1755,796 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
         }
     } while (++CurrentFrame <= n);
 
+    if (RecordAccess && ThreadingMode == FFMS_THREADING_AUTO) {
+        RecentSeeks <<= 1;
+        RecentSeeks[0] = AnySeek;
+        RecentRequests = std::min(RecentRequests + 1, static_cast<int>(RecentSeeks.size()));
+    }
+
     LastFrameNum = n;
-    return OutputFrame(DecodeFrame);
+    FFMS_Frame *Output = OutputFrame(DecodeFrame);
+
+    // Added after output so the cached reference picks up the serialized HDR10+ payload
+    if (!IsLayered)
+        FrameCache.Add(n, DecodeFrame);
+    return Output;
+}
+
+void FFMS_VideoSource::GetFrames(int First, int Last, int Step, TFrameCallback Callback, void *Private) {
+    GetFrameCheck(First);
+    GetFrameCheck(Last);
+    if (First > Last || Step < 1)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Invalid frame range requested");
+
+    // Only the first frame goes through the usual seeking, the rest of the range is decoded onwards from there
+    auto Deliver = [=](FFMS_VideoSource *Decoder) -> FFMS_Frame * {
+        FFMS_Frame *Frame = Decoder->GetFrameInternal(First);
+        for (int n = First; ; ) {
+            ++Stats.FramesReturned;
+            if (Callback(Frame, n, Private))
+                throw FFMS_Exception(FFMS_ERROR_CANCELLED, FFMS_ERROR_USER,
+                    "Cancelled by user");
+            if (Last - n < Step)
+                break;
+            n += Step;
+            Frame = Decoder->DecodeOnwardsTo(n);
+        }
+        return nullptr;
+    };
+
+    if (!PoolMembers.empty()) {
+        WithPooledDecoder(First, Deliver);
+        return;
+    }
+    if (PrefetchSize > 0)
+        PausePrefetch();
+    Deliver(this);
+}
+
+// Decodes up to n straight from where the last returned frame left off. The frames in between are never
+// output, so they never get converted either. Anything that needs a seek goes through GetFrameInternal.
+FFMS_Frame *FFMS_VideoSource::DecodeOnwardsTo(int n) {
+    TraceSpan Span("video", "DecodeOnwards", n);
+    int RealN = Frames.RealFrameNumber(n);
+
+    // Cached frames leave the decoder where it was so it has to be right behind the last returned frame
+    if (Stage != DecodeStage::DECODE_LOOP || LastFrameNum != CurrentFrame - 1 || RealN < CurrentFrame)
+        return GetFrameInternal(n);
+
+    // Same rule as in SeekTo for when skipping ahead beats decoding everything in between
+    if (SeekMode >= 1) {
+        int TargetFrame = SeekMode < 3 ? Frames.FindClosestVideoKeyFrame(RealN) : RealN;
+        if (TargetFrame > CurrentFrame + std::max(1, SeekCosts.SeekDistance()))
+            return GetFrameInternal(n);
+    }
+
+    do {
+        if (((unsigned) CurrentFrame < Frames.size()) && Frames[CurrentFrame].Skipped())
+            continue;
+        auto DecodeStart = std::chrono::steady_clock::now();
+        DecodeNextFrame();
+        SeekCosts.AddFrame(std::chrono::duration<double>(std::chrono::steady_clock::now() - DecodeStart).count());
+    } while (++CurrentFrame <= RealN);
+
+    LastFrameNum = RealN;
+    FFMS_Frame *Output = OutputFrame(DecodeFrame);
+    if (!IsLayered)
+        FrameCache.Add(RealN, DecodeFrame);
+    return Output;
+}
+
+FFMS_Frame *FFMS_VideoSource::GetNearestKeyFrame(int n, int *KeyFrameNumber) {
+    GetFrameCheck(n);
+
+    int KeyFrame = Frames.VisibleFrameNumber(Frames.FindClosestVideoKeyFrame(Frames.RealFrameNumber(n)));
+    if (KeyFrame < 0) {
+        // The keyframe itself is hidden so settle for the closest visible frame flagged as one
+        KeyFrame = n;
+        while (KeyFrame > 0 && !Frames[Frames.RealFrameNumber(KeyFrame)].KeyFrame)
+            --KeyFrame;
+    }
+    if (KeyFrameNumber)
+        *KeyFrameNumber = KeyFrame;
+
+    FFMS_Frame *Frame;
+    if (!PoolMembers.empty()) {
+        Frame = WithPooledDecoder(KeyFrame, [this, KeyFrame](FFMS_VideoSource *Decoder) -> FFMS_Frame * {
+            OwnedFrame *Output = GetPooledOutput();
+            Decoder->GetKeyFrameInternal(KeyFrame);
+            Decoder->CopyOutputFrame(*Output);
+            return &Output->Frame;
+        });
+    } else {
+        if (PrefetchSize > 0)
+            PausePrefetch();
+        Frame = GetKeyFrameInternal(KeyFrame);
+    }
+    ++Stats.FramesReturned;
+    return Frame;
+}
+
+// Decodes nothing but the keyframe n itself by seeking straight to it and draining the decoder after one packet
+FFMS_Frame *FFMS_VideoSource::GetKeyFrameInternal(int n) {
+    int RealN = Frames.RealFrameNumber(n);
+
+    if ((Stage != DecodeStage::INITIALIZE_SOURCE && LastFrameNum == RealN) || (!IsLayered && FrameCache.Contains(RealN)))
+        return GetFrameInternal(n);
+
+    // Layered streams return two pictures per packet and linear access has to keep its position,
+    // for everything else a regular decode is the only thing that's guaranteed to work
+    if (IsLayered || SeekMode < 1 || !Frames[RealN].KeyFrame)
+        return GetFrameInternal(n);
+
+    Seek(RealN);
+    // Whatever happens below the decoder no longer is where CurrentFrame says, so force a seek on the next regular request
+    Stage = DecodeStage::INITIALIZE_SOURCE;
+    CodecContext->skip_frame = AVDISCARD_NONKEY;
+
+    bool Decoded = false;
+    try {
+        SmartAVPacket Packet;
+        bool Sent = false;
+        int ret;
+        while ((ret = ReadPacket(Packet.get())) >= 0) {
+            if (Packet->stream_index == VideoTrack) {
+                int PacketNum = Frames.FindPacket(*Packet);
+                if (PacketNum == RealN) {
+                    Sent = avcodec_send_packet(CodecContext, Packet.get()) == 0;
+                    break;
+                }
+                // Went past it in decoding order so the seek didn't land where it should have
+                if (PacketNum >= 0 && Frames[PacketNum].PosInDecodingOrder > Frames[RealN].PosInDecodingOrder)
+                    break;
+            }
+            av_packet_unref(Packet.get());
+        }
+        if (IsIOError(ret))
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_FILE_READ,
+                "Failed to read packet: " + AVErrorToString(ret));
+
+        ScopedStatTimer Timer(Stats.DecodeTime);
+        if (Sent && avcodec_send_packet(CodecContext, nullptr) == 0)
+            Decoded = avcodec_receive_frame(CodecContext, DecodeFrame) == 0;
+        if (Decoded)
+            ++Stats.FramesDecoded;
+    } catch (FFMS_Exception &) {
+        CodecContext->skip_frame = AVDISCARD_DEFAULT;
+        avcodec_flush_buffers(CodecContext);
+        throw;
+    }
+
+    CodecContext->skip_frame = AVDISCARD_DEFAULT;
+    avcodec_flush_buffers(CodecContext);
+
+    if (!Decoded)
+        return GetFrameInternal(n);
+
+    LastFrameNum = RealN;
+    FFMS_Frame *Output = OutputFrame(DecodeFrame);
+    FrameCache.Add(RealN, DecodeFrame);
+    return Output;
+}
+
+// Lower is better, negative means the frame can be returned without decoding anything
+int FFMS_VideoSource::GetDecodeDistance(int n) const {
+    if (Stage == DecodeStage::INITIALIZE_SOURCE)
+        return std::numeric_limits<int>::max();
+    if (LastFrameNum == n || (!IsLayered && FrameCache.Contains(n)))
+        return -1;
+    if (n >= CurrentFrame)
+        return n - CurrentFrame;
+    return std::numeric_limits<int>::max();
+}
+
+const AVPacket *FFMS_VideoSource::GetPacket(int n) {
+    GetFrameCheck(n);
+    // Reading packets moves the demuxer and only a seek can bring the decoder back to where it was
+    if (SeekMode < 1)
+        throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Packets can't be retrieved in linear access mode");
+
+    if (!PoolMembers.empty()) {
+        AVPacket *Output;
+        {
+            std::lock_guard<std::mutex> Lock(PoolMutex);
+            Output = PooledPackets[std::this_thread::get_id()].get();
+        }
+        WithPooledDecoder(n, [n, Output](FFMS_VideoSource *Decoder) -> FFMS_Frame * {
+            av_packet_unref(Output);
+            if (av_packet_ref(Output, Decoder->GetPacketInternal(n)) < 0)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not reference packet");
+            return nullptr;
+        });
+        return Output;
+    }
+    if (PrefetchSize > 0)
+        PausePrefetch();
+    return GetPacketInternal(n);
+}
+
+// Reads the packet of frame n without decoding it. Sequential requests keep reading where the
+// last one stopped, everything else seeks like a decode would and skips ahead to the packet.
+const AVPacket *FFMS_VideoSource::GetPacketInternal(int n) {
+    TraceSpan Span("video", "GetPacket", n);
+    int RealN = Frames.RealFrameNumber(n);
+    av_packet_unref(RawPacket.get());
+
+    const AVPacket *Cached = Packets.Find(Frames[RealN].FilePos);
+    if (Cached) {
+        if (av_packet_ref(RawPacket.get(), Cached) < 0)
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                "Could not reference cached packet");
+        ++Stats.CachedPackets;
+        return RawPacket.get();
+    }
+
+    // Reading on is never more work than a seek as long as the seek couldn't land on a keyframe in between
+    size_t Target = Frames[RealN].PosInDecodingOrder;
+    bool ReadOn = LastRawPacket >= 0 && Frames[LastRawPacket].PosInDecodingOrder < Target;
+    for (size_t i = ReadOn ? Frames[LastRawPacket].PosInDecodingOrder + 1 : Target; i < Target; i++) {
+        if (Frames[Frames[i].OriginalPos].KeyFrame)
+            ReadOn = false;
+    }
+
+    // Whatever happens below the decoder no longer is where CurrentFrame says, so force a seek on the next regular request
+    Stage = DecodeStage::INITIALIZE_SOURCE;
+
+    // When the seek lands after the packet all that's left is reading the file from the start
+    for (int Attempt = ReadOn ? 0 : 1; Attempt < 3; Attempt++) {
+        if (Attempt == 1)
+            Seek(RealN);
+        else if (Attempt == 2)
+            Seek(Frames[0].OriginalPos);
+
+        int ret;
+        while ((ret = ReadPacket(RawPacket.get())) >= 0) {
+            int PacketNum = Frames.FindPacket(*RawPacket);
+            if (PacketNum == RealN) {
+                LastRawPacket = RealN;
+                return RawPacket.get();
+            }
+            av_packet_unref(RawPacket.get());
+            if (PacketNum >= 0 && Frames[PacketNum].PosInDecodingOrder > Target)
+                break;
+        }
+        if (IsIOError(ret))
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_FILE_READ,
+                "Failed to read packet: " + AVErrorToString(ret));
+    }
+
+    throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_UNKNOWN,
+        "Couldn't find the packet of the requested frame");
+}
+
+void FFMS_VideoSource::GetExtradata(const uint8_t *&Data, int &Size) const {
+    const AVCodecParameters *Par = FormatContext->streams[VideoTrack]->codecpar;
+    Data = Par->extradata;
+    Size = Par->extradata_size;
+}
+
+template <typename T>
+FFMS_Frame *FFMS_VideoSource::WithPooledDecoder(int n, T Request) {
+    GetFrameCheck(n);
+    int RealN = Frames.RealFrameNumber(n);
+
+    FFMS_VideoSource *Decoder;
+    {
+        std::unique_lock<std::mutex> Lock(PoolMutex);
+        PoolCondition.wait(Lock, [this] { return !IdleDecoders.empty(); });
+
+        // Pick the decoder that can reach the frame with the least work, which in
+        // practice is the one closest below it
+        auto Best = IdleDecoders.begin();
+        int BestDistance = (*Best)->GetDecodeDistance(RealN);
+        for (auto Iter = Best + 1; Iter != IdleDecoders.end(); ++Iter) {
+            int Distance = (*Iter)->GetDecodeDistance(RealN);
+            if (Distance < BestDistance) {
+                Best = Iter;
+                BestDistance = Distance;
+            }
+        }
+        Decoder = *Best;
+        IdleDecoders.erase(Best);
+    }
+
+    struct DecoderReturner {
+        FFMS_VideoSource *Pool;
+        FFMS_VideoSource *Decoder;
+        ~DecoderReturner() {
+            {
+                std::lock_guard<std::mutex> Lock(Pool->PoolMutex);
+                Pool->IdleDecoders.push_back(Decoder);
+            }
+            Pool->PoolCondition.notify_one();
+        }
+    } Returner{ this, Decoder };
+
+    return Request(Decoder);
+}
+
+OwnedFrame *FFMS_VideoSource::GetPooledOutput() {
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    std::unique_ptr<OwnedFrame> &Slot = PooledOutput[std::this_thread::get_id()];
+    if (!Slot)
+        Slot.reset(new OwnedFrame());
+    return Slot.get();
+}
+
+OwnedFrame::PlaneSet::~PlaneSet() {
+    av_freep(&Data[0]);
+}
+
+void OwnedFrame::PlaneSet::Assign(const uint8_t * const *SrcData, const int *SrcLinesize, int SrcWidth, int SrcHeight, AVPixelFormat SrcFormat) {
+    if (Width != SrcWidth || Height != SrcHeight || Format != SrcFormat || !Data[0]) {
+        av_freep(&Data[0]);
+        Width = 0;
+        if (av_image_alloc(Data, Linesize, SrcWidth, SrcHeight, SrcFormat, 32) < 0)
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                "Could not allocate output frame copy");
+        Width = SrcWidth;
+        Height = SrcHeight;
+        Format = SrcFormat;
+    }
+    av_image_copy(Data, Linesize, SrcData, SrcLinesize, SrcFormat, SrcWidth, SrcHeight);
+}
+
+void FFMS_VideoSource::GetOutputGeometry(int &Width, int &Height, AVPixelFormat &Format) const {
+    // Layered output points at the unconverted eyes, everything else at the conversion output when there is one
+    bool Converted = !IsLayered && SWS;
+    Width = Converted ? TargetWidth : LocalFrame.EncodedWidth;
+    Height = Converted ? TargetHeight : LocalFrame.EncodedHeight;
+    Format = Converted ? OutputFormat : static_cast<AVPixelFormat>(LocalFrame.EncodedPixelFormat);
+}
+
+void FFMS_VideoSource::CopyFrameProperties(OwnedFrame &Dst) const {
+    Dst.Frame = LocalFrame;
+
+    if (LocalFrame.DolbyVisionRPU) {
+        Dst.RPU.assign(LocalFrame.DolbyVisionRPU, LocalFrame.DolbyVisionRPU + LocalFrame.DolbyVisionRPUSize);
+        Dst.Frame.DolbyVisionRPU = Dst.RPU.data();
+    }
+
+    if (LocalFrame.HDR10Plus) {
+        Dst.HDR10Plus.assign(LocalFrame.HDR10Plus, LocalFrame.HDR10Plus + LocalFrame.HDR10PlusSize);
+        Dst.Frame.HDR10Plus = Dst.HDR10Plus.data();
+    }
+}
+
+void FFMS_VideoSource::CopyOutputFrame(OwnedFrame &Dst) const {
+    CopyFrameProperties(Dst);
+
+    int Width, Height;
+    AVPixelFormat Format;
+    GetOutputGeometry(Width, Height, Format);
+    Dst.Main.Assign(LocalFrame.Data, LocalFrame.Linesize, Width, Height, Format);
+    for (int i = 0; i < 4; i++) {
+        Dst.Frame.Data[i] = Dst.Main.Data[i];
+        Dst.Frame.Linesize[i] = Dst.Main.Linesize[i];
+    }
+
+    if (IsLayered) {
+        AVPixelFormat EyeFormat = static_cast<AVPixelFormat>(LocalFrame.EncodedPixelFormat);
+        Dst.LeftEye.Assign(LocalFrame.LeftEyeData, LocalFrame.LeftEyeLinesize, LocalFrame.EncodedWidth, LocalFrame.EncodedHeight, EyeFormat);
+        Dst.RightEye.Assign(LocalFrame.RightEyeData, LocalFrame.RightEyeLinesize, LocalFrame.EncodedWidth, LocalFrame.EncodedHeight, EyeFormat);
+        for (int i = 0; i < 4; i++) {
+            Dst.Frame.LeftEyeData[i] = Dst.LeftEye.Data[i];
+            Dst.Frame.LeftEyeLinesize[i] = Dst.LeftEye.Linesize[i];
+            Dst.Frame.RightEyeData[i] = Dst.RightEye.Data[i];
+            Dst.Frame.RightEyeLinesize[i] = Dst.RightEye.Linesize[i];
+        }
+    }
+}
+
+FFMS_Frame *FFMS_VideoSource::CreateFrameRef(std::unique_ptr<OwnedFrame> Copy) const {
+    FrameRef *Ref = new FrameRef();
+
+    // A prefetched copy is all there is to it, LocalFrame may be getting written by the prefetch thread meanwhile
+    if (Copy) {
+        Ref->Frame = Copy->Frame;
+        Ref->Copy = Copy.release();
+        return &Ref->Frame;
+    }
+
+    Ref->Frame = LocalFrame;
+    try {
+        if (IsLayered) {
+            // Both the main planes and the eye planes point into the views
+            Ref->LeftEye = av_frame_clone(LeftEyeFrame);
+            Ref->RightEye = av_frame_clone(RightEyeFrame);
+            if (!Ref->LeftEye || !Ref->RightEye)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not reference output frame");
+        } else if (SWS) {
+            Ref->Converted = av_buffer_ref(SWSBuffer);
+            if (!Ref->Converted)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not reference output frame");
+        } else {
+            Ref->Source = av_frame_alloc();
+            if (!Ref->Source || av_frame_ref(Ref->Source, DecodeFrame) < 0)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not reference output frame");
+            for (int i = 0; i < 4; i++)
+                Ref->Frame.Data[i] = Ref->Source->data[i];
+        }
+
+        // Side data buffers are reused by the next frame so they're the only thing that gets copied
+        size_t SideDataSize = LocalFrame.DolbyVisionRPUSize + LocalFrame.HDR10PlusSize;
+        if (SideDataSize > 0) {
+            Ref->SideData = av_buffer_alloc(SideDataSize);
+            if (!Ref->SideData)
+                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                    "Could not allocate frame side data");
+            uint8_t *Dst = Ref->SideData->data;
+            if (LocalFrame.DolbyVisionRPU) {
+                memcpy(Dst, LocalFrame.DolbyVisionRPU, LocalFrame.DolbyVisionRPUSize);
+                Ref->Frame.DolbyVisionRPU = Dst;
+                Dst += LocalFrame.DolbyVisionRPUSize;
+            }
+            if (LocalFrame.HDR10Plus) {
+                memcpy(Dst, LocalFrame.HDR10Plus, LocalFrame.HDR10PlusSize);
+                Ref->Frame.HDR10Plus = Dst;
+            }
+        }
+    } catch (FFMS_Exception &) {
+        ReleaseFrameRef(&Ref->Frame);
+        throw;
+    }
+
+    return &Ref->Frame;
+}
+
+void ReleaseFrameRef(const FFMS_Frame *Frame) {
+    if (!Frame)
+        return;
+    static_assert(std::is_standard_layout<FrameRef>::value, "FrameRef must be standard layout");
+    FrameRef *Ref = reinterpret_cast<FrameRef *>(const_cast<FFMS_Frame *>(Frame));
+    av_frame_free(&Ref->Source);
+    av_buffer_unref(&Ref->Converted);
+    av_frame_free(&Ref->LeftEye);
+    av_frame_free(&Ref->RightEye);
+    av_buffer_unref(&Ref->SideData);
+    delete Ref->Copy;
+    delete Ref;
+}
+
+void FFMS_VideoSource::SetConversionThreads(int Threads) {
+    if (Threads < 0)
+        throw FFMS_Exception(FFMS_ERROR_SCALING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Conversion thread count can't be negative");
+    if (Threads == ConversionThreads)
+        return;
+
+    PausePrefetch();
+    ConversionThreads = Threads;
+    if (!TargetPixelFormats.empty()) {
+        ReAdjustOutputFormat(DecodeFrame);
+        OutputFrame(DecodeFrame);
+    }
+
+    for (auto &Member : PoolMembers)
+        Member->SetConversionThreads(Threads);
+}
+
+void FFMS_VideoSource::SetFrameMetadata(int Mask) {
+    if (Mask & ~FFMS_METADATA_ALL)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Unknown frame metadata type requested");
+
+    PausePrefetch();
+    MetadataExport = Mask;
+    OutputFrame(DecodeFrame);
+
+    for (auto &Member : PoolMembers)
+        Member->SetFrameMetadata(Mask);
+}
+
+void FFMS_VideoSource::SetDecodeProfile(int Profile) {
+    if (Profile < FFMS_DECODE_EXACT || Profile > FFMS_DECODE_PREVIEW)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Invalid decode profile");
+    if (Profile == DecodeProfile)
+        return;
+    if (SeekMode < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "The decode profile can't be changed without seeking");
+
+    PausePrefetch();
+    DecodeProfile = Profile;
+    // Cached frames were decoded with the old settings
+    FrameCache.Clear();
+    ReopenCodec();
+
+    for (auto &Member : PoolMembers)
+        Member->SetDecodeProfile(Profile);
+}
+
+void FFMS_VideoSource::SetThreadingMode(int Mode) {
+    if (Mode < FFMS_THREADING_FRAME || Mode > FFMS_THREADING_AUTO)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Invalid threading mode");
+    bool Slice = Mode == FFMS_THREADING_SLICE;
+    if (Slice != SliceThreading && SeekMode < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "The threading mode can't be changed without seeking");
+
+    PausePrefetch();
+    ThreadingMode = Mode;
+    RecentSeeks.reset();
+    RecentRequests = 0;
+    if (Slice != SliceThreading) {
+        SliceThreading = Slice;
+        ReopenCodec();
+    }
+
+    for (auto &Member : PoolMembers)
+        Member->SetThreadingMode(Mode);
+}
+
+// The new decoder has to start over from a keyframe, which leaves the source in the same state as after opening it
+void FFMS_VideoSource::ReopenCodec() {
+    avcodec_free_context(&CodecContext);
+    OpenCodec();
+
+    Stage = DecodeStage::INITIALIZE_SOURCE;
+    if (Frames.size() > 1 && Seek(0) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Video track is unseekable");
+}
+
+// Switches between frame and slice threading once enough recent requests show that access is mostly random or mostly linear,
+// the wide gap between the two thresholds keeps it from flipping back and forth
+bool FFMS_VideoSource::AdaptThreading() {
+    if (ThreadingMode != FFMS_THREADING_AUTO || SeekMode < 1 || RecentRequests < static_cast<int>(RecentSeeks.size()))
+        return false;
+
+    size_t Seeks = RecentSeeks.count();
+    if (SliceThreading ? Seeks > RecentSeeks.size() / 16 : Seeks < RecentSeeks.size() / 2)
+        return false;
+
+    SliceThreading = !SliceThreading;
+    RecentSeeks.reset();
+    RecentRequests = 0;
+    ++Stats.ThreadingSwitches;
+    ReopenCodec();
+    return true;
+}
+
+void FFMS_VideoSource::GetSeekCosts(double &FrameTime, double &SeekTime) const {
+    SeekCosts.Get(FrameTime, SeekTime);
+}
+
+void FFMS_VideoSource::GetStats(FFMS_VideoSourceStats &Out) const {
+    Out = {};
+    auto Add = [&Out](const VideoSourceCounters &Stats) {
+        Out.Seeks += Stats.Seeks;
+        Out.FailedSeeks += Stats.FailedSeeks;
+        Out.PacketsRead += Stats.PacketsRead;
+        Out.BytesRead += Stats.BytesRead;
+        Out.CachedSeeks += Stats.CachedSeeks;
+        Out.CachedPackets += Stats.CachedPackets;
+        Out.FramesDecoded += Stats.FramesDecoded;
+        Out.FramesReturned += Stats.FramesReturned;
+        Out.ThreadingSwitches += Stats.ThreadingSwitches;
+        Out.DemuxTime += StatSeconds(Stats.DemuxTime);
+        Out.DecodeTime += StatSeconds(Stats.DecodeTime);
+        Out.ConvertTime += StatSeconds(Stats.ConvertTime);
+        Out.MetadataTime += StatSeconds(Stats.MetadataTime);
+    };
+    Add(Stats);
+    for (auto &Member : PoolMembers)
+        Add(Member->Stats);
+}
+
+void FFMS_VideoSource::SetCacheSize(int64_t Bytes) {
+    if (Bytes < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Cache size can't be negative");
+    PausePrefetch();
+    FrameCache.SetMaxSize(static_cast<size_t>(std::min<uint64_t>(Bytes, std::numeric_limits<size_t>::max())));
+    for (auto &Member : PoolMembers)
+        Member->SetCacheSize(Bytes);
+}
+
+void FFMS_VideoSource::SetPacketCacheSize(int64_t Bytes) {
+    if (Bytes < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Packet cache size can't be negative");
+    PausePrefetch();
+    // A replay in progress may lose the packets it still needs so the next request has to seek
+    if (Packets.IsReplaying())
+        Stage = DecodeStage::INITIALIZE_SOURCE;
+    Packets.SetMaxSize(static_cast<size_t>(std::min<uint64_t>(Bytes, std::numeric_limits<size_t>::max())));
+    for (auto &Member : PoolMembers)
+        Member->SetPacketCacheSize(Bytes);
+}
+
+// The pool members read through the same reader so they follow along
+void FFMS_VideoSource::SetReadAhead(int BufferSize, int Depth) {
+    ::SetReadAhead(Reader.get(), BufferSize, Depth);
+}
+
+void FFMS_VideoSource::SetDecoderPoolSize(int Size) {
+    if (Size < 1)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "The decoder pool needs at least one decoder");
+
+    PausePrefetch();
+    std::lock_guard<std::mutex> Lock(PoolMutex);
+    while (static_cast<int>(PoolMembers.size()) > Size - 1)
+        PoolMembers.pop_back();
+    while (static_cast<int>(PoolMembers.size()) < Size - 1)
+        PoolMembers.push_back(std::unique_ptr<FFMS_VideoSource>(new FFMS_VideoSource(this)));
+
+    IdleDecoders.clear();
+    IdleDecoders.push_back(this);
+    for (auto &Member : PoolMembers)
+        IdleDecoders.push_back(Member.get());
+
+    if (PoolMembers.empty())
+        PooledOutput.clear();
+}
+
+FFMS_Frame *FFMS_VideoSource::GetFramePrefetched(int n) {
+    GetFrameCheck(n);
+
+    std::unique_lock<std::mutex> Lock(PrefetchMutex);
+    if (n == PrefetchOutputFrame)
+        return &PrefetchOutput->Frame;
+
+    // Frames that are queued or currently being decoded by the worker only have to be waited for
+    if (PrefetchActive && n <= PrefetchNext && (PrefetchQueue.empty() || PrefetchQueue.front().first <= n)) {
+        while (true) {
+            while (!PrefetchQueue.empty() && PrefetchQueue.front().first < n) {
+                PrefetchSpareFrames.push_back(std::move(PrefetchQueue.front().second));
+                PrefetchQueue.pop_front();
+            }
+            if (!PrefetchQueue.empty() || !PrefetchActive)
+                break;
+            PrefetchProgress.wait(Lock);
+        }
+
+        if (!PrefetchQueue.empty()) {
+            if (PrefetchOutput)
+                PrefetchSpareFrames.push_back(std::move(PrefetchOutput));
+            PrefetchOutput = std::move(PrefetchQueue.front().second);
+            PrefetchQueue.pop_front();
+            PrefetchOutputFrame = n;
+            LastRequestedFrame = n;
+            Lock.unlock();
+            PrefetchWakeup.notify_one();
+            return &PrefetchOutput->Frame;
+        }
+    }
+
+    // Anything else is a seek (or the worker gave up), so take the decoder back and do it here
+    CancelPrefetch(Lock);
+    bool Sequential = (n == LastRequestedFrame + 1);
+    PrefetchOutputFrame = -1;
+    LastRequestedFrame = -1;
+    Lock.unlock();
+
+    FFMS_Frame *Frame = GetFrameInternal(n);
+
+    Lock.lock();
+    LastRequestedFrame = n;
+    if (!Sequential || n + 1 >= VP.NumFrames)
+        return Frame;
+
+    // The worker is about to reuse the decoder's output buffers so hand out a copy instead
+    if (!PrefetchOutput)
+        PrefetchOutput.reset(new OwnedFrame());
+    CopyOutputFrame(*PrefetchOutput);
+    PrefetchOutputFrame = n;
+    PrefetchNext = n + 1;
+    PrefetchActive = true;
+    Lock.unlock();
+    PrefetchWakeup.notify_one();
+    return &PrefetchOutput->Frame;
+}
+
+void FFMS_VideoSource::PrefetchWorker() {
+    std::unique_lock<std::mutex> Lock(PrefetchMutex);
+    while (true) {
+        PrefetchWakeup.wait(Lock, [this] {
+            return PrefetchExit || (PrefetchActive && static_cast<int>(PrefetchQueue.size()) < PrefetchSize && PrefetchNext < VP.NumFrames);
+        });
+        if (PrefetchExit)
+            return;
+
+        int n = PrefetchNext;
+        std::unique_ptr<OwnedFrame> Slot;
+        if (!PrefetchSpareFrames.empty()) {
+            Slot = std::move(PrefetchSpareFrames.back());
+            PrefetchSpareFrames.pop_back();
+        }
+        PrefetchBusy = true;
+        Lock.unlock();
+
+        // Errors are left for the caller to run into again when it decodes the frame itself
+        bool Success = true;
+        try {
+            if (!Slot)
+                Slot.reset(new OwnedFrame());
+            GetFrameInternal(n);
+            CopyOutputFrame(*Slot);
+        } catch (...) {
+            Success = false;
+        }
+
+        Lock.lock();
+        PrefetchBusy = false;
+        if (!Success) {
+            PrefetchActive = false;
+        } else if (PrefetchActive && n == PrefetchNext) {
+            PrefetchQueue.emplace_back(n, std::move(Slot));
+            PrefetchNext++;
+        }
+        if (Slot)
+            PrefetchSpareFrames.push_back(std::move(Slot));
+        PrefetchProgress.notify_all();
+    }
+}
+
+void FFMS_VideoSource::CancelPrefetch(std::unique_lock<std::mutex> &Lock) {
+    PrefetchActive = false;
+    PrefetchProgress.wait(Lock, [this] { return !PrefetchBusy; });
+    for (auto &Entry : PrefetchQueue)
+        PrefetchSpareFrames.push_back(std::move(Entry.second));
+    PrefetchQueue.clear();
+}
+
+void FFMS_VideoSource::PausePrefetch() {
+    std::unique_lock<std::mutex> Lock(PrefetchMutex);
+    CancelPrefetch(Lock);
+    PrefetchOutputFrame = -1;
+    LastRequestedFrame = -1;
+}
+
+void FFMS_VideoSource::StopPrefetchThread() {
+    {
+        std::lock_guard<std::mutex> Lock(PrefetchMutex);
+        PrefetchExit = true;
+        PrefetchActive = false;
+    }
+    PrefetchWakeup.notify_one();
+    if (PrefetchThread.joinable())
+        PrefetchThread.join();
+
+    PrefetchExit = false;
+    PrefetchQueue.clear();
+    PrefetchSpareFrames.clear();
+    PrefetchOutput.reset();
+    PrefetchOutputFrame = -1;
+    LastRequestedFrame = -1;
+}
+
+void FFMS_VideoSource::SetPrefetchSize(int Frames) {
+    if (Frames < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Prefetch size can't be negative");
+
+    if (Frames == 0) {
+        StopPrefetchThread();
+        PrefetchSize = 0;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> Lock(PrefetchMutex);
+        CancelPrefetch(Lock);
+        PrefetchSize = Frames;
+    }
+
+    if (!PrefetchThread.joinable()) {
+        try {
+            PrefetchThread = std::thread(&FFMS_VideoSource::PrefetchWorker, this);
+        } catch (std::system_error &) {
+            PrefetchSize = 0;
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+                "Could not start prefetch thread");
+        }
+    }
 }
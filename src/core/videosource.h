@@ -34,8 +34,20 @@ extern "C" {
 #include <libavutil/hdr_dynamic_metadata.h>
 }
 
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "demuxer.h"
+#include "memorygovernor.h"
 #include "track.h"
 #include "utils.h"
 
@@ -59,11 +71,212 @@ struct DecoderDelay {
     bool IsExceeded();
 };
 
+// Running estimates of how long decoding a frame and seeking (including the decoder warming
+// up again) take, so SeekTo can pick whichever gets to the requested frame sooner
+class SeekCostModel {
+    mutable std::mutex Mutex;
+    double FrameTime = 0;
+    double SeekTime = 0;
+    int FrameSamples = 0;
+    int SeekSamples = 0;
+public:
+    // Used until enough has been measured
+    static constexpr int DefaultSeekDistance = 10;
+
+    void AddFrame(double Seconds);
+    void AddSeek(double Seconds);
+    void Get(double &FrameSeconds, double &SeekSeconds) const;
+    // How many frames ahead a keyframe has to be for seeking to it to be faster than decoding there
+    int SeekDistance() const;
+};
+
+// Running totals behind FFMS_VideoSourceStats, times are in nanoseconds
+struct VideoSourceCounters {
+    StatCounter Seeks{0};
+    StatCounter FailedSeeks{0};
+    StatCounter PacketsRead{0};
+    StatCounter BytesRead{0};
+    StatCounter CachedSeeks{0};
+    StatCounter CachedPackets{0};
+    StatCounter FramesDecoded{0};
+    StatCounter FramesReturned{0};
+    StatCounter ThreadingSwitches{0};
+    StatCounter DemuxTime{0};
+    StatCounter DecodeTime{0};
+    StatCounter ConvertTime{0};
+    StatCounter MetadataTime{0};
+};
+
+// LRU cache of decoded (not yet converted) frames, keyed by real frame number.
+// Entries are av_frame_ref'd so holding them costs no copies, only the decoder
+// buffers they keep alive. The size is measured in bytes of referenced buffers.
+class DecodedFrameCache {
+    struct CacheEntry {
+        int FrameNumber;
+        AVFrame *Frame;
+        size_t Size;
+    };
+
+    std::list<CacheEntry> Entries; // most recently used first
+    std::unordered_map<int, std::list<CacheEntry>::iterator> Lookup;
+    size_t MaxSize = 0;
+    size_t CurrentSize = 0;
+    MemoryCharge Charge{ MemoryGovernor::FRAME_CACHE };
+
+    void EvictTo(size_t Limit);
+public:
+    DecodedFrameCache() = default;
+    DecodedFrameCache(const DecodedFrameCache &) = delete;
+    DecodedFrameCache &operator=(const DecodedFrameCache &) = delete;
+    ~DecodedFrameCache();
+
+    void SetMaxSize(size_t Bytes);
+    size_t GetMaxSize() const { return MaxSize; }
+    size_t GetSize() const { return CurrentSize; }
+    bool Contains(int n) const { return Lookup.count(n) > 0; }
+    AVFrame *Get(int n);
+    void Add(int n, const AVFrame *Frame);
+    // Drops the oldest frames while the memory governor is over its limit, with Extra more bytes in use
+    void Shrink(size_t Extra = 0);
+    void Clear();
+};
+
+// Compressed packets of the stretches of the file read after the most recent seeks. Seeking to a keyframe
+// whose packet is still here replays the packets from there instead of asking the demuxer again.
+class PacketCache {
+    struct Run {
+        std::deque<AVPacket *> Packets;
+        size_t Size = 0;
+    };
+
+    std::list<Run> Runs; // most recently started first
+    // The run the demuxer is positioned at the end of, which new packets get appended to
+    std::list<Run>::iterator Live;
+    bool HaveLive = false;
+    std::list<Run>::iterator Replay;
+    size_t ReplayPos = 0;
+    bool Replaying = false;
+    size_t MaxSize = 0;
+    size_t CurrentSize = 0;
+    MemoryCharge Charge{ MemoryGovernor::FRAME_CACHE };
+
+    void DropOldest();
+    void EvictTo(size_t Limit);
+public:
+    PacketCache() = default;
+    PacketCache(const PacketCache &) = delete;
+    PacketCache &operator=(const PacketCache &) = delete;
+    ~PacketCache();
+
+    void SetMaxSize(size_t Bytes);
+    size_t GetMaxSize() const { return MaxSize; }
+    // Called after every seek of the demuxer, the packets read from then on form a new run
+    void StartRun();
+    void Add(const AVPacket *Packet);
+    const AVPacket *Find(int64_t Pos) const;
+    // Starts replaying from the packet read from Pos, returns false if it isn't cached
+    bool Seek(int64_t Pos);
+    bool IsReplaying() const { return Replaying; }
+    // Returns false once the replayed run is exhausted
+    bool Next(AVPacket *Packet);
+    // Ends a replay that ran out of packets. Returns true with the run's first and last packet when the
+    // demuxer isn't right behind them, ContinueRun then has to be called once it has been put there.
+    bool FinishReplay(const AVPacket *&First, const AVPacket *&Last);
+    void ContinueRun();
+    void Clear();
+};
+
+// Small LRU of swscale contexts together with a buffer pool for their output, keyed by everything
+// GetSwsContext is given, so switching back to a previously seen resolution or format is free
+class SwsContextCache {
+public:
+    struct Key {
+        int SrcWidth;
+        int SrcHeight;
+        AVPixelFormat SrcFormat;
+        int SrcColorSpace;
+        int SrcColorRange;
+        int DstWidth;
+        int DstHeight;
+        AVPixelFormat DstFormat;
+        int DstColorSpace;
+        int DstColorRange;
+        int64_t Flags;
+        int Threads;
+
+        bool operator==(const Key &Other) const;
+    };
+
+    struct Entry {
+        Key Params;
+        SwsContext *Context;
+        AVBufferPool *Pool;
+    };
+
+private:
+    std::list<Entry> Entries; // most recently used first
+    size_t MaxEntries;
+
+public:
+    explicit SwsContextCache(size_t MaxEntries = 4) : MaxEntries(MaxEntries) {}
+    SwsContextCache(const SwsContextCache &) = delete;
+    SwsContextCache &operator=(const SwsContextCache &) = delete;
+    ~SwsContextCache();
+
+    // Returns nullptr if no context could be created for the parameters
+    const Entry *Get(const Key &Params);
+    void Clear();
+};
+
+// Deep copy of an output frame which stays valid independently of the decoder that produced it
+struct OwnedFrame {
+    struct PlaneSet {
+        uint8_t *Data[4] = {};
+        int Linesize[4] = {};
+        int Width = 0;
+        int Height = 0;
+        AVPixelFormat Format = AV_PIX_FMT_NONE;
+
+        PlaneSet() = default;
+        PlaneSet(const PlaneSet &) = delete;
+        PlaneSet &operator=(const PlaneSet &) = delete;
+        ~PlaneSet();
+        void Assign(const uint8_t * const *SrcData, const int *SrcLinesize, int SrcWidth, int SrcHeight, AVPixelFormat SrcFormat);
+    };
+
+    FFMS_Frame Frame = {};
+    PlaneSet Main;
+    PlaneSet LeftEye;
+    PlaneSet RightEye;
+    std::vector<uint8_t> RPU;
+    std::vector<uint8_t> HDR10Plus;
+};
+
+// What FFMS_GetFrameRef hands out, Frame has to stay the first member so the public pointer maps back to it.
+// Only one of Source, Converted, the eyes and Copy is set, depending on where the pixel data lives.
+struct FrameRef {
+    FFMS_Frame Frame;
+    AVFrame *Source;
+    AVBufferRef *Converted;
+    AVFrame *LeftEye;
+    AVFrame *RightEye;
+    AVBufferRef *SideData;
+    OwnedFrame *Copy;
+};
+
+void ReleaseFrameRef(const FFMS_Frame *Frame);
+
 struct FFMS_VideoSource {
 private:
+    // Both SWS and SWSBufferPool are owned by ConversionCache
+    SwsContextCache ConversionCache;
     SwsContext *SWS = nullptr;
 
     DecoderDelay Delay;
+    // Rough size of the frames the decoder keeps alive, only an estimate since they're allocated internally
+    MemoryCharge DecoderMemory{ MemoryGovernor::DECODER };
+    SeekCostModel SeekCosts;
+    VideoSourceCounters Stats;
     DecodeStage Stage = DecodeStage::INITIALIZE_SOURCE;
 
     int LastFrameHeight = -1;
@@ -74,6 +287,8 @@ private:
     int TargetWidth = -1;
     std::vector<AVPixelFormat> TargetPixelFormats;
     int TargetResizer = 0;
+    int ConversionThreads = 1;
+    AVFrame *ConversionFrame = nullptr;
 
     AVPixelFormat OutputFormat = AV_PIX_FMT_NONE;
     AVColorRange OutputColorRange = AVCOL_RANGE_UNSPECIFIED;
@@ -90,14 +305,19 @@ private:
     AVColorRange InputColorRange = AVCOL_RANGE_UNSPECIFIED;
     AVColorSpace InputColorSpace = AVCOL_SPC_UNSPECIFIED;
 
+    // Conversion output comes from a pool so frame references can keep a buffer alive while the next frame is converted
+    AVBufferPool *SWSBufferPool = nullptr;
+    AVBufferRef *SWSBuffer = nullptr;
+    int SWSBufferWidth = 0;
+    int SWSBufferHeight = 0;
+    AVPixelFormat SWSBufferFormat = AV_PIX_FMT_NONE;
     uint8_t *SWSFrameData[4] = {};
     int SWSFrameLinesize[4] = {};
     bool EyesInverted = false;
     bool PrimaryEyeIsLeft = true;
-    uint8_t *LeftEyeFrameData[4] = {};
-    int LeftEyeLinesize[4] = {};
-    uint8_t *RightEyeFrameData[4] = {};
-    int RightEyeLinesize[4] = {};
+    // References to the views of the last layered frame, only replaced when the decoder outputs new ones
+    AVFrame *LeftEyeFrame = nullptr;
+    AVFrame *RightEyeFrame = nullptr;
 
     SmartAVPacket StashedPacket;
     bool ResendPacket = false;
@@ -107,29 +327,106 @@ private:
 
     FFMS_VideoProperties VP = {};
     FFMS_Frame LocalFrame = {};
+    // Caller supplied planes OutputFrame writes to instead of its own buffers, only set during GetFrameInto
+    uint8_t * const *OutputTarget = nullptr;
+    const int *OutputTargetLinesize = nullptr;
+    bool LocalFrameIsExternal = false;
+    FFMS_Frame TargetFrame = {};
     uint8_t *RPUBuffer = nullptr;
     size_t RPUBufferSize = 0;
-    uint8_t *HDR10PlusBuffer = nullptr;
-    size_t HDR10PlusBufferSize = 0;
+    int MetadataExport = FFMS_METADATA_ALL;
     AVFrame *DecodeFrame = nullptr;
     AVFrame *LastDecodedFrame = nullptr;
     int LastFrameNum = 0;
-    FFMS_Index &Index;
+    std::string SourceFile;
+    std::shared_ptr<InputReader> Reader;
+    std::map<std::string, std::string> LAVFOpts;
     FFMS_Track Frames;
     int VideoTrack;
     int CurrentFrame = 1;
     int DecodingThreads;
     AVCodecContext *CodecContext = nullptr;
+    DemuxHandle Demuxer;
+    // Owned by Demuxer
     AVFormatContext *FormatContext = nullptr;
     int SeekMode;
     bool SeekByPos = false;
     bool HaveSeenInterlacedFrame = false;
+    // Which views of a multilayer stream get decoded, IsLayered is only set when that's more than one
+    int Views;
     bool IsLayered = false;
+    int DecodeProfile = FFMS_DECODE_EXACT;
+    // Whether slice threads are used instead of frame threads, in automatic mode this follows whether
+    // most of the last requests needed a seek
+    int ThreadingMode = FFMS_THREADING_FRAME;
+    bool SliceThreading = false;
+    std::bitset<32> RecentSeeks;
+    int RecentRequests = 0;
+    DecodedFrameCache FrameCache;
+    PacketCache Packets;
+
+    // Additional decoders opened by SetDecoderPoolSize, each only used by the thread that checked it out
+    std::vector<std::unique_ptr<FFMS_VideoSource>> PoolMembers;
+    std::vector<FFMS_VideoSource *> IdleDecoders;
+    std::mutex PoolMutex;
+    std::condition_variable PoolCondition;
+    std::map<std::thread::id, std::unique_ptr<OwnedFrame>> PooledOutput;
+    std::map<std::thread::id, SmartAVPacket> PooledPackets;
+
+    // Compressed packet returned by GetPacket, and the frame it belonged to for as long as nothing else moved the demuxer
+    SmartAVPacket RawPacket;
+    int LastRawPacket = -1;
+
+    // Read-ahead worker for linear access, owns the decoder whenever PrefetchActive or PrefetchBusy is set
+    int PrefetchSize = 0;
+    std::thread PrefetchThread;
+    std::mutex PrefetchMutex;
+    std::condition_variable PrefetchWakeup;
+    std::condition_variable PrefetchProgress;
+    bool PrefetchExit = false;
+    bool PrefetchActive = false;
+    bool PrefetchBusy = false;
+    int PrefetchNext = 0;
+    int LastRequestedFrame = -1;
+    int PrefetchOutputFrame = -1;
+    std::deque<std::pair<int, std::unique_ptr<OwnedFrame>>> PrefetchQueue;
+    std::vector<std::unique_ptr<OwnedFrame>> PrefetchSpareFrames;
+    std::unique_ptr<OwnedFrame> PrefetchOutput;
+
+    explicit FFMS_VideoSource(const FFMS_VideoSource *Parent);
+    void OpenDecoder(bool ShareDemuxer);
+    void OpenCodec();
+    void ReopenCodec();
+    bool AdaptThreading();
+    FFMS_Frame *GetFrameInternal(int n);
+    FFMS_Frame *DecodeOnwardsTo(int n);
+    FFMS_Frame *GetFrameIntoInternal(int n, uint8_t * const *DstData, const int *DstLinesize);
+    FFMS_Frame *GetKeyFrameInternal(int n);
+    template <typename T>
+    FFMS_Frame *WithPooledDecoder(int n, T Request);
+    OwnedFrame *GetPooledOutput();
+    const AVPacket *GetPacketInternal(int n);
+    int GetDecodeDistance(int n) const;
+    void GetOutputGeometry(int &Width, int &Height, AVPixelFormat &Format) const;
+    void CopyFrameProperties(OwnedFrame &Dst) const;
+    void CopyOutputFrame(OwnedFrame &Dst) const;
+    FFMS_Frame *CreateFrameRef(std::unique_ptr<OwnedFrame> Copy = nullptr) const;
+    void UseSWSBufferPool(AVBufferPool *Pool, int Width, int Height, AVPixelFormat Format);
+    void ConvertFrame(AVFrame *Frame, uint8_t * const *Dst, const int *DstLinesize, AVBufferRef *DstBuffer);
+    void NextSWSBuffer();
+    FFMS_Frame *GetFramePrefetched(int n);
+    void PrefetchWorker();
+    void CancelPrefetch(std::unique_lock<std::mutex> &Lock);
+    void PausePrefetch();
+    void StopPrefetchThread();
 
     void ReAdjustOutputFormat(AVFrame *Frame);
     FFMS_Frame *OutputFrame(AVFrame *Frame);
     void SetVideoProperties();
     bool DecodePacket(const AVPacket &Packet);
+    int ReadPacket(AVPacket *Packet);
+    // Puts the demuxer right after the packets replayed from the packet cache when they run out
+    void ResumeAfterReplay();
 
     // Returns the first packet read
     SmartAVPacket DecodeNextFrame();
@@ -138,18 +435,37 @@ private:
     void Free();
     static void SanityCheckFrameForData(AVFrame *Frame);
 public:
-    FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, int Track, int Threads, int SeekMode);
+    FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, int Track, int Threads, int SeekMode, int Views, const std::shared_ptr<InputReader> &Reader = nullptr);
     ~FFMS_VideoSource();
     const FFMS_VideoProperties& GetVideoProperties() { return VP; }
     FFMS_Track *GetTrack() { return &Frames; }
     FFMS_Frame *GetFrame(int n);
+    FFMS_Frame *GetFrameRef(int n);
+    FFMS_Frame *GetFrameInto(int n, uint8_t * const *DstData, const int *DstLinesize);
+    FFMS_Frame *GetFrameByTimeInto(double Time, uint8_t * const *DstData, const int *DstLinesize);
+    FFMS_Frame *GetNearestKeyFrame(int n, int *KeyFrameNumber);
+    const AVPacket *GetPacket(int n);
+    void GetExtradata(const uint8_t *&Data, int &Size) const;
+    void GetFrames(int First, int Last, int Step, TFrameCallback Callback, void *Private);
     void GetFrameCheck(int n);
-    void CopyEye(AVStereo3DView view);
+    void ReferenceEye(AVStereo3DView view);
+    int GetFrameNumberFromTime(double Time);
     FFMS_Frame *GetFrameByTime(double Time);
     void SetOutputFormat(const AVPixelFormat *TargetFormats, int Width, int Height, int Resizer);
     void ResetOutputFormat();
     void SetInputFormat(int ColorSpace, int ColorRange, AVPixelFormat Format);
     void ResetInputFormat();
+    void SetCacheSize(int64_t Bytes);
+    void SetPacketCacheSize(int64_t Bytes);
+    void SetDecoderPoolSize(int Size);
+    void SetReadAhead(int BufferSize, int Depth);
+    void SetPrefetchSize(int Frames);
+    void SetConversionThreads(int Threads);
+    void SetFrameMetadata(int Mask);
+    void SetDecodeProfile(int Profile);
+    void SetThreadingMode(int Mode);
+    void GetSeekCosts(double &FrameTime, double &SeekTime) const;
+    void GetStats(FFMS_VideoSourceStats &Out) const;
 };
 
 #endif
@@ -29,7 +29,7 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
-SwsContext *GetSwsContext(int SrcW, int SrcH, AVPixelFormat SrcFormat, int SrcColorSpace, int SrcColorRange, int DstW, int DstH, AVPixelFormat DstFormat, int DstColorSpace, int DstColorRange, int64_t Flags) {
+SwsContext *GetSwsContext(int SrcW, int SrcH, AVPixelFormat SrcFormat, int SrcColorSpace, int SrcColorRange, int DstW, int DstH, AVPixelFormat DstFormat, int DstColorSpace, int DstColorRange, int64_t Flags, int Threads) {
     Flags |= SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND;
     SwsContext *Context = sws_alloc_context();
     if (!Context) return nullptr;
@@ -51,6 +51,8 @@ SwsContext *GetSwsContext(int SrcW, int SrcH, AVPixelFormat SrcFormat, int SrcCo
     av_opt_set_int(Context, "dst_range", DstRange, 0);
     av_opt_set_int(Context, "src_format", SrcFormat, 0);
     av_opt_set_int(Context, "dst_format", DstFormat, 0);
+    // Each thread converts its own band of the output with a separate internal context
+    av_opt_set_int(Context, "threads", Threads, 0);
 
     sws_setColorspaceDetails(Context,
         sws_getCoefficients(SrcColorSpace), SrcRange,
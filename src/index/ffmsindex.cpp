@@ -49,6 +49,7 @@ bool Overwrite = false;
 bool PrintProgress = true;
 bool WriteTC = false;
 bool WriteKF = false;
+bool VerifySeekPoints = false;
 int64_t ProgressInterval = 1000000; // One second
 std::vector<FFMS_KeyValuePair> LAVFOpts;
 std::string InputFile;
@@ -87,6 +88,9 @@ void PrintUsage() {
         "FFmpeg Demuxer Options:\n"
         "--enable_drefs\n"
         "--use_absolute_path\n"
+        "\n"
+        "Other Options:\n"
+        "--verify_seek_points  Check which keyframes can be seeked to, makes seeking in broken files faster (default: no)\n"
         << std::endl;
 }
 
@@ -162,6 +166,8 @@ void ParseCMDLine(int argc, const char *argv[]) {
             parseDemuxerOpts("enable_drefs=1");
         } else if (!strcmp(Option, "--use_absolute_path")) {
             parseDemuxerOpts("use_absolute_path=1");
+        } else if (!strcmp(Option, "--verify_seek_points")) {
+            VerifySeekPoints = true;
         } else if (InputFile.empty()) {
             InputFile = Option;
         } else if (CacheFile.empty()) {
@@ -233,6 +239,7 @@ void DoIndexing() {
         throw Error("\nFailed to initialize indexing: ", E);
 
     FFMS_SetProgressCallback(Indexer, UpdateProgress, &ProgressTracker);
+    FFMS_SetSeekPointVerification(Indexer, VerifySeekPoints);
 
     // Treat -1 as meaning track numbers above sizeof(long long) * 8 too, dumping implies indexing
     if (IndexMask == -1)
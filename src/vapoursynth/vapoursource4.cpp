@@ -29,6 +29,9 @@
 #include <utility>
 #include <vector>
 
+// VapourSynth RGB planes are R, G, B while the FFmpeg planar RGB formats are G, B, R
+static const int RGBPlaneOrder[3] = { 2, 0, 1 };
+
 static int GetNumPixFmts() {
     int n = 0;
     while (av_get_pix_fmt_name((AVPixelFormat)n))
@@ -118,18 +121,43 @@ const VSFrame *VS_CC VSVideoSource4::GetVSFrame(int n, VSCore *core, const VSAPI
 
     VSFrame *Dst = vsapi->newVideoFrame(&VI[0].format, VI[0].width, VI[0].height, nullptr, core);
     VSMap *Props = vsapi->getFramePropertiesRW(Dst);
+    VSFrame *AlphaDst = nullptr;
+    if (OutputAlpha)
+        AlphaDst = vsapi->newVideoFrame(&VI[1].format, VI[1].width, VI[1].height, nullptr, core);
+
+    // Let the conversion write straight into the new frames when their planes match the output exactly
+    uint8_t *DstPlanes[4] = {};
+    int DstStrides[4] = {};
+    if (DirectOutput) {
+        const VSVideoFormat &fi = VI[0].format;
+        for (int i = 0; i < fi.numPlanes; i++) {
+            int Plane = (fi.colorFamily == cfRGB) ? RGBPlaneOrder[i] : i;
+            DstPlanes[Plane] = vsapi->getWritePtr(Dst, i);
+            DstStrides[Plane] = static_cast<int>(vsapi->getStride(Dst, i));
+        }
+        if (AlphaDst) {
+            DstPlanes[fi.numPlanes] = vsapi->getWritePtr(AlphaDst, 0);
+            DstStrides[fi.numPlanes] = static_cast<int>(vsapi->getStride(AlphaDst, 0));
+        }
+    }
 
     const FFMS_Frame *Frame = nullptr;
 
     if (FPSNum > 0 && FPSDen > 0) {
         double currentTime = FFMS_GetVideoProperties(V)->FirstTime +
             (double)(n * (int64_t)FPSDen) / FPSNum;
-        Frame = FFMS_GetFrameByTime(V, currentTime, &E);
+        if (DirectOutput)
+            Frame = FFMS_GetFrameByTimeInto(V, currentTime, DstPlanes, DstStrides, &E);
+        else
+            Frame = FFMS_GetFrameByTime(V, currentTime, &E);
         vsapi->mapSetInt(Props, "_DurationNum", FPSDen, maReplace);
         vsapi->mapSetInt(Props, "_DurationDen", FPSNum, maReplace);
         vsapi->mapSetFloat(Props, "_AbsoluteTime", currentTime, maReplace);
     } else {
-        Frame = FFMS_GetFrame(V, n, &E);
+        if (DirectOutput)
+            Frame = FFMS_GetFrameInto(V, n, DstPlanes, DstStrides, &E);
+        else
+            Frame = FFMS_GetFrame(V, n, &E);
         FFMS_Track *T = FFMS_GetTrackFromVideo(V);
         const FFMS_TrackTimeBase *TB = FFMS_GetTimeBase(T);
         int64_t num;
@@ -147,8 +175,11 @@ const VSFrame *VS_CC VSVideoSource4::GetVSFrame(int n, VSCore *core, const VSAPI
         vsapi->mapSetFloat(Props, "_AbsoluteTime", ((static_cast<double>(TB->Num) / 1000) * FFMS_GetFrameInfo(T, n)->PTS) / TB->Den, maReplace);
     }
 
-    if (Frame == nullptr)
+    if (Frame == nullptr) {
+        vsapi->freeFrame(Dst);
+        vsapi->freeFrame(AlphaDst);
         throw std::runtime_error(E.Buffer);
+    }
 
     // Set AR variables
     if (SARNum > 0 && SARDen > 0) {
@@ -199,11 +230,12 @@ const VSFrame *VS_CC VSVideoSource4::GetVSFrame(int n, VSCore *core, const VSAPI
         vsapi->mapSetData(Props, "HDR10Plus", reinterpret_cast<const char *>(Frame->HDR10Plus), Frame->HDR10PlusSize, dtBinary, maReplace);
     }
 
-    OutputFrame(Frame, Dst, vsapi);
-    if (OutputAlpha) {
-        VSFrame *AlphaDst = vsapi->newVideoFrame(&VI[1].format, VI[1].width, VI[1].height, nullptr, core);
+    if (!DirectOutput)
+        OutputFrame(Frame, Dst, vsapi);
+    if (AlphaDst) {
         vsapi->mapSetInt(vsapi->getFramePropertiesRW(AlphaDst), "_ColorRange", 0, maReplace);
-        OutputAlphaFrame(Frame, VI[0].format.numPlanes, AlphaDst, vsapi);
+        if (!DirectOutput)
+            OutputAlphaFrame(Frame, VI[0].format.numPlanes, AlphaDst, vsapi);
         vsapi->mapConsumeFrame(Props, "_Alpha", AlphaDst, maReplace);
     }
 
@@ -231,7 +263,9 @@ const VSFrame *VS_CC VSVideoSource4::GetFrame(int n, int activationReason, void
 
         try {
             const VSFrame *frame = vs->GetVSFrame(n, core, vsapi);
-            vs->LastFrame = n;
+            // Only tracked for linear access, parallel sources never catch up on skipped frames
+            if (vs->CacheThreshold > 0)
+                vs->LastFrame = n;
             return frame;
         } catch (std::runtime_error &e) {
             vsapi->setFilterError(e.what(), frameCtx);
@@ -247,9 +281,9 @@ void VS_CC VSVideoSource4::Free(void *instanceData, VSCore *, const VSAPI *) {
 }
 
 VSVideoSource4::VSVideoSource4(const char *SourceFile, int Track, FFMS_Index *Index,
-    int AFPSNum, int AFPSDen, int Threads, int SeekMode,
+    int AFPSNum, int AFPSDen, int Threads, int SeekMode, int Views,
     int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
-    int Format, bool OutputAlpha, const VSAPI *vsapi, VSCore *core)
+    int Format, bool OutputAlpha, int Decoders, const VSAPI *vsapi, VSCore *core)
     : FPSNum(AFPSNum), FPSDen(AFPSDen), OutputAlpha(OutputAlpha) {
 
     VI[0] = {};
@@ -260,12 +294,14 @@ VSVideoSource4::VSVideoSource4(const char *SourceFile, int Track, FFMS_Index *In
     E.Buffer = ErrorMsg;
     E.BufferSize = sizeof(ErrorMsg);
 
-    V = FFMS_CreateVideoSource(SourceFile, Track, Index, Threads, SeekMode, &E);
+    V = FFMS_CreateVideoSource2(SourceFile, Track, Index, Threads, SeekMode, Views, &E);
     if (!V) {
         throw std::runtime_error(std::string("Source: ") + E.Buffer);
     }
     try {
         InitOutputFormat(ResizeToWidth, ResizeToHeight, ResizerName, Format, vsapi, core);
+        if (Decoders > 1 && FFMS_SetVideoDecoderPoolSize(V, Decoders, &E))
+            throw std::runtime_error(std::string("Source: ") + E.Buffer);
     } catch (std::exception &) {
         FFMS_DestroyVideoSource(V);
         throw;
@@ -384,10 +420,13 @@ void VSVideoSource4::InitOutputFormat(int ResizeToWidth, int ResizeToHeight,
     // Crop to obey subsampling width/height requirements
     VI[0].width -= VI[0].width % (1 << VI[0].format.subSamplingW);
     VI[0].height -= VI[0].height % (1 << VI[0].format.subSamplingH);
+
+    // Cropped frames, layered video or an alpha plane with nowhere to go still need an intermediate copy
+    DirectOutput = VI[0].width == F->ScaledWidth && VI[0].height == F->ScaledHeight && !F->LeftEyeData[0] &&
+        (OutputAlpha || !HasAlpha(*av_pix_fmt_desc_get((AVPixelFormat)F->ConvertedPixelFormat)));
 }
 
 void VSVideoSource4::OutputFrame(const FFMS_Frame *Frame, VSFrame *Dst, const VSAPI *vsapi) {
-    const int RGBPlaneOrder[3] = { 2, 0, 1 };
     const VSVideoFormat *fi = vsapi->getVideoFrameFormat(Dst);
     if (fi->colorFamily == cfRGB) {
         for (int i = 0; i < fi->numPlanes; i++)
@@ -43,6 +43,7 @@ private:
     int SARNum;
     int SARDen;
     bool OutputAlpha;
+    bool DirectOutput = false;
     int LastFrame = -1;
     int CacheThreshold = 0;
 
@@ -52,9 +53,9 @@ private:
     static void OutputAlphaFrame(const FFMS_Frame *Frame, int Plane, VSFrame *Dst, const VSAPI *vsapi);
 public:
     VSVideoSource4(const char *SourceFile, int Track, FFMS_Index *Index,
-        int AFPSNum, int AFPSDen, int Threads, int SeekMode,
+        int AFPSNum, int AFPSDen, int Threads, int SeekMode, int Views,
         int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
-        int Format, bool OutputAlpha, const VSAPI *vsapi, VSCore *core);
+        int Format, bool OutputAlpha, int Decoders, const VSAPI *vsapi, VSCore *core);
     ~VSVideoSource4();
 
     const VSVideoInfo *GetVideoInfo() const;
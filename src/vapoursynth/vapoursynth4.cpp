@@ -135,6 +135,12 @@ static void VS_CC CreateSource(const VSMap *in, VSMap *out, void *, VSCore *core
     int Format = vsapi->mapGetIntSaturated(in, "format", 0, &err);
 
     bool OutputAlpha = !!vsapi->mapGetInt(in, "alpha", 0, &err);
+    int Decoders = vsapi->mapGetIntSaturated(in, "decoders", 0, &err);
+    if (err)
+        Decoders = 1;
+    int Views = vsapi->mapGetIntSaturated(in, "view", 0, &err);
+    if (err)
+        Views = FFMS_VIEWS_ALL;
 
     if (FPSDen < 1)
         return vsapi->mapSetError(out, "Source: FPS denominator needs to be 1 or higher");
@@ -142,6 +148,10 @@ static void VS_CC CreateSource(const VSMap *in, VSMap *out, void *, VSCore *core
         return vsapi->mapSetError(out, "Source: No video track selected");
     if (SeekMode < -1 || SeekMode > 3)
         return vsapi->mapSetError(out, "Source: Invalid seekmode selected");
+    if (Decoders < 1)
+        return vsapi->mapSetError(out, "Source: Invalid number of decoders");
+    if (Views < FFMS_VIEWS_PRIMARY)
+        return vsapi->mapSetError(out, "Source: Invalid view selected");
     if (Timecodes && IsSamePath(Source, Timecodes))
         return vsapi->mapSetError(out, "Source: Timecodes will overwrite the source");
 
@@ -198,14 +208,16 @@ static void VS_CC CreateSource(const VSMap *in, VSMap *out, void *, VSCore *core
 
     VSVideoSource4 *vs;
     try {
-        vs = new VSVideoSource4(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, Width, Height, Resizer, Format, OutputAlpha, vsapi, core);
+        vs = new VSVideoSource4(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, Views, Width, Height, Resizer, Format, OutputAlpha, Decoders, vsapi, core);
     } catch (std::exception const& e) {
         FFMS_DestroyIndex(Index);
         return vsapi->mapSetError(out, e.what());
     }
 
-    VSNode *node = vsapi->createVideoFilter2("Source", vs->GetVideoInfo(), VSVideoSource4::GetFrame, VSVideoSource4::Free, fmUnordered, nullptr, 0, vs, core);
-    vs->SetCacheThreshold(vsapi->setLinearFilter(node));
+    // With a decoder pool frames can be requested from several threads at once
+    VSNode *node = vsapi->createVideoFilter2("Source", vs->GetVideoInfo(), VSVideoSource4::GetFrame, VSVideoSource4::Free, (Decoders > 1) ? fmParallel : fmUnordered, nullptr, 0, vs, core);
+    if (Decoders == 1)
+        vs->SetCacheThreshold(vsapi->setLinearFilter(node));
     vsapi->mapConsumeNode(out, "clip", node, maAppend);
 
     FFMS_DestroyIndex(Index);
@@ -230,7 +242,7 @@ static void VS_CC GetVersion(const VSMap *, VSMap *out, void *, VSCore *, const
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
     vspapi->configPlugin("com.vapoursynth.ffms2", "ffms2", "FFmpegSource 2 for VapourSynth", FFMS_GetVersion(), VAPOURSYNTH_API_VERSION, 0, plugin);
     vspapi->registerFunction("Index", "source:data;cachefile:data:opt;indextracks:int[]:opt;errorhandling:int:opt;overwrite:int:opt;enable_drefs:int:opt;use_absolute_path:int:opt;", "result:data;", CreateIndex, nullptr, plugin);
-    vspapi->registerFunction("Source", "source:data;track:int:opt;cache:int:opt;cachefile:data:opt;fpsnum:int:opt;fpsden:int:opt;threads:int:opt;timecodes:data:opt;seekmode:int:opt;width:int:opt;height:int:opt;resizer:data:opt;format:int:opt;alpha:int:opt;", "clip:vnode;", CreateSource, nullptr, plugin);
+    vspapi->registerFunction("Source", "source:data;track:int:opt;cache:int:opt;cachefile:data:opt;fpsnum:int:opt;fpsden:int:opt;threads:int:opt;timecodes:data:opt;seekmode:int:opt;width:int:opt;height:int:opt;resizer:data:opt;format:int:opt;alpha:int:opt;decoders:int:opt;view:int:opt;", "clip:vnode;", CreateSource, nullptr, plugin);
     vspapi->registerFunction("GetLogLevel", "", "level:int;", GetLogLevel, nullptr, plugin);
     vspapi->registerFunction("SetLogLevel", "level:int;", "level:int;", SetLogLevel, nullptr, plugin);
     vspapi->registerFunction("Version", "", "version:data;", GetVersion, nullptr, plugin);
@@ -153,6 +153,30 @@ TEST_F(HDR10Test, StreamAndContainerData) {
     ASSERT_TRUE(TEST_DOUBLE(VP->MasteringDisplayMaxLuminance, StreamHDR10Data.MasteringDisplayMaxLuminance));
 }
 
+TEST_F(HDR10Test, MetadataExportMask) {
+    std::string FilePath = SamplesDir + "/hdr10tags-stream.mp4";
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    const FFMS_Frame *Frame = FFMS_GetFrame(video_source, 0, &E);
+    ASSERT_NE(nullptr, Frame);
+    ASSERT_TRUE(!!Frame->HasMasteringDisplayPrimaries);
+
+    ASSERT_EQ(0, FFMS_SetVideoFrameMetadata(video_source, FFMS_METADATA_ALL & ~FFMS_METADATA_MASTERING_DISPLAY, &E));
+    Frame = FFMS_GetFrame(video_source, 0, &E);
+    ASSERT_NE(nullptr, Frame);
+    EXPECT_FALSE(!!Frame->HasMasteringDisplayPrimaries);
+    EXPECT_FALSE(!!Frame->HasMasteringDisplayLuminance);
+
+    ASSERT_EQ(0, FFMS_SetVideoFrameMetadata(video_source, FFMS_METADATA_ALL, &E));
+    Frame = FFMS_GetFrame(video_source, 0, &E);
+    ASSERT_NE(nullptr, Frame);
+    ASSERT_TRUE(!!Frame->HasMasteringDisplayPrimaries);
+    ASSERT_TRUE(TEST_DOUBLE(Frame->MasteringDisplayWhitePointX, StreamHDR10Data.MasteringDisplayWhitePointX));
+
+    EXPECT_NE(0, FFMS_SetVideoFrameMetadata(video_source, 0x100, &E));
+}
+
 } //namespace
 
 int main(int argc, char **argv) {
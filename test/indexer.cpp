@@ -1,12 +1,22 @@
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 #include <string>
 #include <random>
+#include <thread>
 #include <vector>
 
 #include <ffms.h>
 #include <gtest/gtest.h>
 
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
 #include "data/test.mp4.cpp"
 #include "data/vp9_audfirst.webm.cpp"
 #include "data/qrvideo_24fps_1elist_1ctts.mov.cpp"
@@ -151,6 +161,924 @@ TEST_P(IndexerTest, RandomAccessingFrame) {
     }
 }
 
+TEST_P(IndexerTest, CachedBackAndForthAccess) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+    ASSERT_EQ(0, FFMS_SetVideoCacheSize(video_source, 64 * 1024 * 1024, &E));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Revisit the previous two frames after each new one so most requests hit the cache
+    for (int i = 0; i < VP->NumFrames; i++) {
+        for (int num = std::max(0, i - 2); num <= i; num++) {
+            std::stringstream ss;
+            ss << "Testing Frame: " << num;
+            SCOPED_TRACE(ss.str());
+
+            const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, num);
+
+            const FFMS_Frame* frame = FFMS_GetFrame(video_source, num, &E);
+            ASSERT_NE(nullptr, frame);
+            ASSERT_TRUE(CheckFrame(frame, info, &P.TestData[num]));
+        }
+    }
+}
+
+TEST_P(IndexerTest, PrefetchedLinearAccess) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+    ASSERT_EQ(0, FFMS_SetVideoPrefetch(video_source, 4, &E));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // A linear pass with a small skip inside the read-ahead window followed by a seek back to the start
+    std::vector<int> Order;
+    for (int i = 0; i < VP->NumFrames; i++)
+        Order.push_back(i);
+    if (VP->NumFrames > 4)
+        Order.erase(Order.begin() + 2);
+    Order.push_back(0);
+    Order.push_back(1);
+
+    for (int num : Order) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, num);
+
+        const FFMS_Frame* frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, info, &P.TestData[num]));
+    }
+}
+
+TEST_P(IndexerTest, HeldFrameRefs) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Hold on to every frame until the end so each one has to survive the decoding of all the others
+    std::vector<const FFMS_Frame *> Frames;
+    for (int i = 0; i < VP->NumFrames; i++) {
+        const FFMS_Frame *frame = FFMS_GetFrameRef(video_source, i, &E);
+        ASSERT_NE(nullptr, frame);
+        Frames.push_back(frame);
+    }
+
+    for (int num = 0; num < VP->NumFrames; num++) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, num);
+        EXPECT_TRUE(CheckFrame(Frames[num], info, &P.TestData[num]));
+    }
+
+    for (const FFMS_Frame *frame : Frames)
+        FFMS_ReleaseFrame(frame);
+}
+
+TEST_P(IndexerTest, GetFrameIntoCallerBuffers) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    const FFMS_Frame *first = FFMS_GetFrame(video_source, 0, &E);
+    ASSERT_NE(nullptr, first);
+
+    uint8_t *Planes[4] = {};
+    int Strides[4] = {};
+    ASSERT_LE(0, av_image_alloc(Planes, Strides, first->EncodedWidth, first->EncodedHeight, (AVPixelFormat) first->ConvertedPixelFormat, 32));
+
+    for (int num = 0; num < VP->NumFrames; num++) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, num);
+
+        const FFMS_Frame* frame = FFMS_GetFrameInto(video_source, num, Planes, Strides, &E);
+        ASSERT_NE(nullptr, frame);
+        EXPECT_EQ(Planes[0], frame->Data[0]);
+        EXPECT_TRUE(CheckFrame(frame, info, &P.TestData[num]));
+    }
+
+    av_freep(&Planes[0]);
+}
+
+TEST_P(IndexerTest, ThreadedConversionMatches) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    int Formats[] = { FFMS_GetPixFmt("bgra"), -1 };
+    ASSERT_EQ(0, FFMS_SetOutputFormatV2(video_source, Formats, P.TestData[0].Width, P.TestData[0].Height, FFMS_RESIZER_BICUBIC, &E));
+
+    int num = VP->NumFrames / 2;
+    const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+    ASSERT_NE(nullptr, frame);
+    std::vector<uint8_t> Expected;
+    for (int y = 0; y < frame->ScaledHeight; y++)
+        Expected.insert(Expected.end(), frame->Data[0] + y * frame->Linesize[0], frame->Data[0] + y * frame->Linesize[0] + frame->ScaledWidth * 4);
+
+    ASSERT_EQ(0, FFMS_SetVideoConversionThreads(video_source, 4, &E));
+    frame = FFMS_GetFrame(video_source, num, &E);
+    ASSERT_NE(nullptr, frame);
+    std::vector<uint8_t> Threaded;
+    for (int y = 0; y < frame->ScaledHeight; y++)
+        Threaded.insert(Threaded.end(), frame->Data[0] + y * frame->Linesize[0], frame->Data[0] + y * frame->Linesize[0] + frame->ScaledWidth * 4);
+
+    EXPECT_TRUE(Expected == Threaded);
+}
+
+TEST_P(IndexerTest, SwitchingBackToCachedConversion) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    int BGRA[] = { FFMS_GetPixFmt("bgra"), -1 };
+    int Gray[] = { FFMS_GetPixFmt("gray"), -1 };
+    int Width = P.TestData[0].Width;
+    int Height = P.TestData[0].Height;
+    ASSERT_EQ(0, FFMS_SetOutputFormatV2(video_source, BGRA, Width, Height, FFMS_RESIZER_BICUBIC, &E));
+
+    int num = VP->NumFrames / 2;
+    const FFMS_Frame *held = FFMS_GetFrameRef(video_source, num, &E);
+    ASSERT_NE(nullptr, held);
+    std::vector<uint8_t> Expected;
+    for (int y = 0; y < held->ScaledHeight; y++)
+        Expected.insert(Expected.end(), held->Data[0] + y * held->Linesize[0], held->Data[0] + y * held->Linesize[0] + held->ScaledWidth * 4);
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(0, FFMS_SetOutputFormatV2(video_source, Gray, Width / 2, Height / 2, FFMS_RESIZER_BILINEAR, &E));
+        ASSERT_NE(nullptr, FFMS_GetFrame(video_source, num, &E));
+        ASSERT_EQ(0, FFMS_SetOutputFormatV2(video_source, BGRA, Width, Height, FFMS_RESIZER_BICUBIC, &E));
+
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        std::vector<uint8_t> Converted;
+        for (int y = 0; y < frame->ScaledHeight; y++)
+            Converted.insert(Converted.end(), frame->Data[0] + y * frame->Linesize[0], frame->Data[0] + y * frame->Linesize[0] + frame->ScaledWidth * 4);
+        EXPECT_TRUE(Expected == Converted);
+    }
+
+    // The held reference must not have been handed out again by the reused conversion
+    std::vector<uint8_t> Held;
+    for (int y = 0; y < held->ScaledHeight; y++)
+        Held.insert(Held.end(), held->Data[0] + y * held->Linesize[0], held->Data[0] + y * held->Linesize[0] + held->ScaledWidth * 4);
+    EXPECT_TRUE(Expected == Held);
+    FFMS_ReleaseFrame(held);
+}
+
+TEST_P(IndexerTest, ViewSelectionOnRegularVideo) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    EXPECT_EQ(nullptr, FFMS_CreateVideoSource2(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, -3, &E));
+
+    // Not a multilayer stream so selecting a view changes nothing
+    FFMS_VideoSource *primary = FFMS_CreateVideoSource2(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_PRIMARY, &E);
+    ASSERT_NE(nullptr, primary);
+    EXPECT_EQ(VP->NumFrames, FFMS_GetVideoProperties(primary)->NumFrames);
+    const FFMS_Frame *frame = FFMS_GetFrame(primary, 0, &E);
+    ASSERT_NE(nullptr, frame);
+    EXPECT_EQ(nullptr, frame->LeftEyeData[0]);
+    FFMS_DestroyVideoSource(primary);
+}
+
+TEST_P(IndexerTest, NearestKeyFrameAccess) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Walk backwards so every keyframe needs a seek, with regular requests in between
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 3) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        int key = -1;
+        const FFMS_Frame *frame = FFMS_GetNearestKeyFrame(video_source, num, &key, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_GE(key, 0);
+        ASSERT_LE(key, num);
+        const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, key);
+        EXPECT_TRUE(info->KeyFrame);
+        ASSERT_TRUE(CheckFrame(frame, info, &P.TestData[key]));
+
+        frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+}
+
+TEST_P(IndexerTest, DecodeProfileSwitching) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    int last = VP->NumFrames - 1;
+
+    EXPECT_NE(0, FFMS_SetVideoDecodeProfile(video_source, 3, &E));
+
+    const FFMS_Frame *frame = FFMS_GetFrame(video_source, 0, &E);
+    ASSERT_NE(nullptr, frame);
+    int width = frame->EncodedWidth;
+    int height = frame->EncodedHeight;
+
+    for (int profile : { FFMS_DECODE_FAST, FFMS_DECODE_PREVIEW }) {
+        ASSERT_EQ(0, FFMS_SetVideoDecodeProfile(video_source, profile, &E));
+        for (int num : { last, 0 }) {
+            frame = FFMS_GetFrame(video_source, num, &E);
+            ASSERT_NE(nullptr, frame);
+            EXPECT_LE(frame->EncodedWidth, width);
+            EXPECT_LE(frame->EncodedHeight, height);
+        }
+    }
+
+    // Going back has to give the exact frames again
+    ASSERT_EQ(0, FFMS_SetVideoDecodeProfile(video_source, FFMS_DECODE_EXACT, &E));
+    for (int num : { last, 0 }) {
+        frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+}
+
+TEST_P(IndexerTest, SeekCostsAreMeasured) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    double frame_time = -1, seek_time = -1;
+    FFMS_GetVideoSeekCosts(video_source, &frame_time, &seek_time);
+    EXPECT_EQ(0, frame_time);
+    EXPECT_EQ(0, seek_time);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Jump around so the estimates actually get used, frames still have to come out right
+    for (int num : { 0, VP->NumFrames - 1, VP->NumFrames / 2, VP->NumFrames / 2 + 1, VP->NumFrames / 2 + 2, 1 }) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+
+    FFMS_GetVideoSeekCosts(video_source, &frame_time, &seek_time);
+    EXPECT_GE(frame_time, 0);
+    EXPECT_GT(seek_time, 0);
+}
+
+TEST_P(IndexerTest, VerifiedSeekPoints) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    indexer = FFMS_CreateIndexer(FilePath.c_str(), &E);
+    ASSERT_NE(nullptr, indexer);
+    FFMS_TrackTypeIndexSettings(indexer, FFMS_TYPE_VIDEO, 1, 0);
+    FFMS_SetSeekPointVerification(indexer, 1);
+    index = FFMS_DoIndexing2(indexer, 0, &E);
+    ASSERT_NE(nullptr, index);
+
+    // The verified seek points have to survive writing the index
+    uint8_t *buffer = nullptr;
+    size_t size = 0;
+    ASSERT_EQ(0, FFMS_WriteIndexToBuffer(&buffer, &size, index, &E));
+    FFMS_DestroyIndex(index);
+    index = FFMS_ReadIndexFromBuffer(buffer, size, &E);
+    FFMS_FreeIndexBuffer(&buffer);
+    ASSERT_NE(nullptr, index);
+
+    video_track_idx = FFMS_GetFirstTrackOfType(index, FFMS_TYPE_VIDEO, &E);
+    video_source = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, &E);
+    ASSERT_NE(nullptr, video_source);
+    VP = FFMS_GetVideoProperties(video_source);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = VP->NumFrames - 1; num >= 0; num--) {
+        std::stringstream ss;
+        ss << "Testing Frame: " << num;
+        SCOPED_TRACE(ss.str());
+
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+}
+
+TEST_P(IndexerTest, ThreadingModes) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    indexer = FFMS_CreateIndexer(FilePath.c_str(), &E);
+    ASSERT_NE(nullptr, indexer);
+    index = FFMS_DoIndexing2(indexer, 0, &E);
+    ASSERT_NE(nullptr, index);
+    video_track_idx = FFMS_GetFirstTrackOfType(index, FFMS_TYPE_VIDEO, &E);
+    video_source = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 4, FFMS_SEEK_NORMAL, &E);
+    ASSERT_NE(nullptr, video_source);
+    VP = FFMS_GetVideoProperties(video_source);
+
+    EXPECT_NE(0, FFMS_SetVideoThreadingMode(video_source, 3, &E));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Backwards access seeks for nearly every frame so automatic mode has to switch to slice threading at some point,
+    // it goes over the frames twice so that even short files make enough requests for it to decide
+    for (int mode : { FFMS_THREADING_SLICE, FFMS_THREADING_AUTO, FFMS_THREADING_FRAME }) {
+        ASSERT_EQ(0, FFMS_SetVideoThreadingMode(video_source, mode, &E));
+        FFMS_VideoSourceStats Before;
+        FFMS_GetVideoSourceStats(video_source, &Before);
+        for (int pass = 0; pass < 2; pass++) {
+            for (int num = VP->NumFrames - 1; num >= 0; num--) {
+                std::stringstream ss;
+                ss << "Mode: " << mode << " Testing Frame: " << num;
+                SCOPED_TRACE(ss.str());
+
+                const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+                ASSERT_NE(nullptr, frame);
+                ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+            }
+        }
+        FFMS_VideoSourceStats After;
+        FFMS_GetVideoSourceStats(video_source, &After);
+        if (mode == FFMS_THREADING_AUTO)
+            EXPECT_EQ(1, After.ThreadingSwitches - Before.ThreadingSwitches);
+        else
+            EXPECT_EQ(Before.ThreadingSwitches, After.ThreadingSwitches);
+    }
+}
+
+struct RangeCheck {
+    FFMS_Track *Track;
+    const TestFrameData *Data;
+    std::vector<int> Delivered;
+    int StopAfter;
+};
+
+int FFMS_CC CheckRangeFrame(const FFMS_Frame *Frame, int n, void *Private) {
+    RangeCheck *Check = static_cast<RangeCheck *>(Private);
+    EXPECT_TRUE(CheckFrame(Frame, FFMS_GetFrameInfo(Check->Track, n), &Check->Data[n]));
+    Check->Delivered.push_back(n);
+    return static_cast<int>(Check->Delivered.size()) == Check->StopAfter;
+}
+
+TEST_P(IndexerTest, StridedRangeRetrieval) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    RangeCheck Check = { FFMS_GetTrackFromIndex(index, video_track_idx), P.TestData, {}, -1 };
+    int last = VP->NumFrames - 1;
+
+    EXPECT_NE(0, FFMS_GetFrames(video_source, 0, last, 0, CheckRangeFrame, &Check, &E));
+    EXPECT_NE(0, FFMS_GetFrames(video_source, last, 0, 1, CheckRangeFrame, &Check, &E));
+    EXPECT_TRUE(Check.Delivered.empty());
+
+    ASSERT_EQ(0, FFMS_GetFrames(video_source, 1, last, 3, CheckRangeFrame, &Check, &E));
+    std::vector<int> Expected;
+    for (int num = 1; num <= last; num += 3)
+        Expected.push_back(num);
+    EXPECT_EQ(Expected, Check.Delivered);
+
+    // Stopping early is reported as cancellation
+    Check.Delivered.clear();
+    Check.StopAfter = 2;
+    EXPECT_NE(0, FFMS_GetFrames(video_source, 0, last, 1, CheckRangeFrame, &Check, &E));
+    EXPECT_EQ(2u, Check.Delivered.size());
+}
+
+TEST_P(IndexerTest, SourceStatsAreCounted) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    FFMS_VideoSourceStats Stats;
+    FFMS_GetVideoSourceStats(video_source, &Stats);
+    EXPECT_EQ(0, Stats.FramesReturned);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 5) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+
+    FFMS_GetVideoSourceStats(video_source, &Stats);
+    EXPECT_EQ((VP->NumFrames + 4) / 5, Stats.FramesReturned);
+    EXPECT_GE(Stats.FramesDecoded, Stats.FramesReturned);
+    EXPECT_GT(Stats.Seeks, 0);
+    EXPECT_GT(Stats.PacketsRead, 0);
+    EXPECT_GT(Stats.BytesRead, Stats.PacketsRead);
+    EXPECT_GT(Stats.DecodeTime, 0.0);
+    EXPECT_GE(Stats.DemuxTime, 0.0);
+}
+
+TEST_P(IndexerTest, TraceEventsAreWritten) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+    const char *TraceFile = "indexer_trace.json";
+
+    EXPECT_NE(0, FFMS_SetTraceFile("", &E));
+    ASSERT_EQ(0, FFMS_SetTraceFile(TraceFile, &E));
+    ASSERT_TRUE(DoIndexing(FilePath));
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 7)
+        ASSERT_NE(nullptr, FFMS_GetFrame(video_source, num, &E));
+    ASSERT_EQ(0, FFMS_SetTraceFile(nullptr, &E));
+
+    std::ifstream Stream(TraceFile);
+    std::stringstream Contents;
+    Contents << Stream.rdbuf();
+    Stream.close();
+    std::remove(TraceFile);
+
+    std::string Trace = Contents.str();
+    ASSERT_FALSE(Trace.empty());
+    EXPECT_EQ('[', Trace.front());
+    EXPECT_EQ("]\n", Trace.substr(Trace.size() - 2));
+    for (const char *Name : { "\"DoIndexing\"", "\"GetFrame\"", "\"Seek\"", "\"ReadPacket\"", "\"DecodePacket\"", "\"OutputFrame\"" })
+        EXPECT_NE(std::string::npos, Trace.find(Name)) << Name;
+}
+
+TEST_P(IndexerTest, MemoryLimitShrinksCaches) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+    ASSERT_EQ(0, FFMS_SetVideoCacheSize(video_source, 1 << 30, &E));
+    EXPECT_NE(0, FFMS_SetMemoryLimit(-1, &E));
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    auto DecodeAll = [&]() {
+        for (int num = 0; num < VP->NumFrames; num++) {
+            const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+            ASSERT_NE(nullptr, frame);
+            ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+        }
+    };
+
+    DecodeAll();
+    FFMS_MemoryUsage Usage;
+    FFMS_GetMemoryUsage(&Usage);
+    EXPECT_EQ(0, Usage.Limit);
+    EXPECT_GT(Usage.VideoFrameCaches, 0);
+    EXPECT_GT(Usage.Decoders, 0);
+    EXPECT_EQ(Usage.Total, Usage.VideoFrameCaches + Usage.AudioCaches + Usage.Decoders);
+
+    // The decoder alone is over this limit so the cache has to give up every frame it gets to touch
+    ASSERT_EQ(0, FFMS_SetMemoryLimit(1, &E));
+    DecodeAll();
+    FFMS_GetMemoryUsage(&Usage);
+    ASSERT_EQ(0, FFMS_SetMemoryLimit(0, &E));
+    EXPECT_EQ(1, Usage.Limit);
+    EXPECT_EQ(0, Usage.VideoFrameCaches);
+}
+
+TEST_P(IndexerTest, SharedDemuxerSources) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    FFMS_SetDemuxerSharing(1);
+    bool Indexed = DoIndexing(FilePath);
+    FFMS_VideoSource *Second = Indexed ? FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, &E) : nullptr;
+    FFMS_SetDemuxerSharing(0);
+    ASSERT_TRUE(Indexed);
+    ASSERT_NE(nullptr, Second);
+
+    // Both start out reading together, then the second one goes backwards and has to leave
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = 0; num < VP->NumFrames; num++) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+
+        int SecondNum = num < VP->NumFrames / 2 ? num : VP->NumFrames - 1 - num + VP->NumFrames / 2;
+        frame = FFMS_GetFrame(Second, SecondNum, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, SecondNum), &P.TestData[SecondNum]));
+    }
+
+    FFMS_DestroyVideoSource(Second);
+
+    // Sources reading through the same callbacks in step read the data only once between them when sharing
+    struct CountedData {
+        std::string Contents;
+        int64_t BytesRead = 0;
+    } Counted;
+    std::ifstream Stream(FilePath, std::ios::binary);
+    Counted.Contents.assign(std::istreambuf_iterator<char>(Stream), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(Counted.Contents.empty());
+
+    FFMS_Input Input = {};
+    Input.Read = [](void *Private, int64_t Offset, uint8_t *Buf, int Size) {
+        CountedData *Data = static_cast<CountedData *>(Private);
+        if (Offset >= static_cast<int64_t>(Data->Contents.size()))
+            return 0;
+        int Count = static_cast<int>(std::min<int64_t>(Size, Data->Contents.size() - Offset));
+        memcpy(Buf, Data->Contents.data() + Offset, Count);
+        Data->BytesRead += Count;
+        return Count;
+    };
+    Input.GetSize = [](void *Private) {
+        return static_cast<int64_t>(static_cast<const CountedData *>(Private)->Contents.size());
+    };
+    Input.Private = &Counted;
+
+    auto ReadInStep = [&](bool Share) -> int64_t {
+        Counted.BytesRead = 0;
+        FFMS_SetDemuxerSharing(Share);
+        FFMS_VideoSource *Sources[2] = {
+            FFMS_CreateVideoSourceFromInput(P.Filename, &Input, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E),
+            FFMS_CreateVideoSourceFromInput(P.Filename, &Input, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E)
+        };
+        FFMS_SetDemuxerSharing(0);
+        for (int num = 0; num < VP->NumFrames && Sources[0] && Sources[1]; num++) {
+            for (FFMS_VideoSource *Source : Sources) {
+                const FFMS_Frame *frame = FFMS_GetFrame(Source, num, &E);
+                EXPECT_NE(nullptr, frame);
+                if (frame)
+                    EXPECT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+            }
+        }
+        EXPECT_NE(nullptr, Sources[0]);
+        EXPECT_NE(nullptr, Sources[1]);
+        FFMS_DestroyVideoSource(Sources[0]);
+        FFMS_DestroyVideoSource(Sources[1]);
+        return Counted.BytesRead;
+    };
+
+    int64_t SharedBytes = ReadInStep(true);
+    int64_t PrivateBytes = ReadInStep(false);
+    EXPECT_LT(SharedBytes, PrivateBytes);
+}
+
+TEST_P(IndexerTest, PacketCacheReplay) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+    EXPECT_NE(0, FFMS_SetVideoPacketCacheSize(video_source, -1, &E));
+    ASSERT_EQ(0, FFMS_SetVideoPacketCacheSize(video_source, 64 << 20, &E));
+
+    // Going backwards after a linear pass only seeks to keyframes whose packets were just read
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = 0; num < VP->NumFrames; num++) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+    FFMS_VideoSourceStats Before;
+    FFMS_GetVideoSourceStats(video_source, &Before);
+
+    for (int num = VP->NumFrames - 1; num >= 0; num--) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+    FFMS_VideoSourceStats After;
+    FFMS_GetVideoSourceStats(video_source, &After);
+    EXPECT_GT(After.CachedSeeks, 0);
+    EXPECT_GT(After.CachedPackets, 0);
+    EXPECT_EQ(Before.Seeks, After.Seeks);
+    EXPECT_EQ(Before.PacketsRead, After.PacketsRead);
+}
+
+TEST_P(IndexerTest, RawPacketAccess) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    const uint8_t *Extradata;
+    int ExtradataSize;
+    FFMS_GetVideoExtradata(video_source, &Extradata, &ExtradataSize);
+    EXPECT_EQ(ExtradataSize == 0, Extradata == nullptr);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    std::vector<std::string> Packets(VP->NumFrames);
+    for (int num = 0; num < VP->NumFrames; num++) {
+        const uint8_t *Data;
+        int Size;
+        FFMS_PacketInfo Info;
+        ASSERT_EQ(0, FFMS_GetPacket(video_source, num, &Data, &Size, &Info, &E));
+        ASSERT_GT(Size, 0);
+        if (FFMS_GetFrameInfo(track, num)->KeyFrame)
+            EXPECT_NE(0, Info.KeyFrame);
+        Packets[num].assign(reinterpret_cast<const char *>(Data), Size);
+    }
+
+    // Going backwards has to seek for every packet and still find the same ones
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 3) {
+        const uint8_t *Data;
+        int Size;
+        ASSERT_EQ(0, FFMS_GetPacket(video_source, num, &Data, &Size, nullptr, &E));
+        EXPECT_EQ(Packets[num], std::string(reinterpret_cast<const char *>(Data), Size));
+    }
+
+    // Decoding isn't confused by where packet access left the file
+    int num = VP->NumFrames / 2;
+    const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+    ASSERT_NE(nullptr, frame);
+    ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+}
+
+TEST_P(IndexerTest, InputFromMemory) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    std::ifstream Stream(FilePath, std::ios::binary);
+    std::string Contents((std::istreambuf_iterator<char>(Stream)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(Contents.empty());
+
+    FFMS_Input Input = {};
+    Input.Buffer = reinterpret_cast<const uint8_t *>(Contents.data());
+    Input.BufferSize = Contents.size();
+
+    indexer = FFMS_CreateIndexerFromInput(P.Filename, &Input, nullptr, 0, &E);
+    ASSERT_NE(nullptr, indexer);
+    FFMS_TrackTypeIndexSettings(indexer, FFMS_TYPE_VIDEO, 1, 0);
+    index = FFMS_DoIndexing2(indexer, 0, &E);
+    ASSERT_NE(nullptr, index);
+
+    video_track_idx = FFMS_GetFirstTrackOfType(index, FFMS_TYPE_VIDEO, &E);
+    ASSERT_GE(video_track_idx, 0);
+    video_source = FFMS_CreateVideoSourceFromInput(P.Filename, &Input, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E);
+    ASSERT_NE(nullptr, video_source);
+    VP = FFMS_GetVideoProperties(video_source);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 2) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+
+    // The same data behind callbacks gives the same frames
+    FFMS_Input Callbacks = {};
+    Callbacks.Read = [](void *Private, int64_t Offset, uint8_t *Buf, int Size) {
+        const std::string *Data = static_cast<const std::string *>(Private);
+        if (Offset >= static_cast<int64_t>(Data->size()))
+            return 0;
+        int Count = static_cast<int>(std::min<int64_t>(Size, Data->size() - Offset));
+        memcpy(Buf, Data->data() + Offset, Count);
+        return Count;
+    };
+    Callbacks.GetSize = [](void *Private) {
+        return static_cast<int64_t>(static_cast<const std::string *>(Private)->size());
+    };
+    Callbacks.Private = &Contents;
+
+    FFMS_VideoSource *other = FFMS_CreateVideoSourceFromInput(P.Filename, &Callbacks, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E);
+    ASSERT_NE(nullptr, other);
+    int num = VP->NumFrames / 2;
+    const FFMS_Frame *frame = FFMS_GetFrame(other, num, &E);
+    EXPECT_NE(nullptr, frame);
+    if (frame)
+        EXPECT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    FFMS_DestroyVideoSource(other);
+
+    // An index of a different file is rejected, the changed byte is within the first MiB that goes into the signature
+    std::string Modified = Contents;
+    Modified[std::min<size_t>(Modified.size(), 1 << 20) / 2] ^= 1;
+    FFMS_Input ModifiedInput = {};
+    ModifiedInput.Buffer = reinterpret_cast<const uint8_t *>(Modified.data());
+    ModifiedInput.BufferSize = Modified.size();
+    EXPECT_EQ(nullptr, FFMS_CreateVideoSourceFromInput(P.Filename, &ModifiedInput, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E));
+}
+
+TEST_P(IndexerTest, MemoryMappedInput) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    FFMS_SetMemoryMappedInput(1);
+    bool Indexed = DoIndexing(FilePath);
+    FFMS_SetMemoryMappedInput(0);
+    ASSERT_TRUE(Indexed);
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 2) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+
+    // Indexes made either way are interchangeable
+    FFMS_VideoSource *other = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, &E);
+    ASSERT_NE(nullptr, other);
+    FFMS_DestroyVideoSource(other);
+}
+
+TEST_P(IndexerTest, ReadAheadThrottledInput) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    // Sources reading through libavformat can't read ahead
+    ASSERT_TRUE(DoIndexing(FilePath));
+    EXPECT_NE(0, FFMS_SetVideoReadAhead(video_source, 64 * 1024, 4, &E));
+    FFMS_DestroyVideoSource(video_source);
+    video_source = nullptr;
+    FFMS_DestroyIndex(index);
+    index = nullptr;
+
+    std::ifstream Stream(FilePath, std::ios::binary);
+    std::string Contents((std::istreambuf_iterator<char>(Stream)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(Contents.empty());
+
+    // Slow storage that only hands out a little at a time
+    FFMS_Input Input = {};
+    Input.Read = [](void *Private, int64_t Offset, uint8_t *Buf, int Size) {
+        const std::string *Data = static_cast<const std::string *>(Private);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (Offset >= static_cast<int64_t>(Data->size()))
+            return 0;
+        int Count = static_cast<int>(std::min<int64_t>(std::min(Size, 4096), Data->size() - Offset));
+        memcpy(Buf, Data->data() + Offset, Count);
+        return Count;
+    };
+    Input.GetSize = [](void *Private) {
+        return static_cast<int64_t>(static_cast<const std::string *>(Private)->size());
+    };
+    Input.Private = &Contents;
+
+    EXPECT_NE(0, FFMS_SetReadAhead(1024, 4, &E));
+    ASSERT_EQ(0, FFMS_SetReadAhead(64 * 1024, 8, &E));
+    indexer = FFMS_CreateIndexerFromInput(P.Filename, &Input, nullptr, 0, &E);
+    FFMS_SetReadAhead(1024 * 1024, 0, &E);
+    ASSERT_NE(nullptr, indexer);
+    ASSERT_EQ(0, FFMS_SetIndexerReadAhead(indexer, 256 * 1024, 16, &E));
+    FFMS_TrackTypeIndexSettings(indexer, FFMS_TYPE_VIDEO, 1, 0);
+    index = FFMS_DoIndexing2(indexer, 0, &E);
+    ASSERT_NE(nullptr, index);
+
+    video_track_idx = FFMS_GetFirstTrackOfType(index, FFMS_TYPE_VIDEO, &E);
+    ASSERT_GE(video_track_idx, 0);
+    video_source = FFMS_CreateVideoSourceFromInput(P.Filename, &Input, video_track_idx, index, 1, FFMS_SEEK_NORMAL, FFMS_VIEWS_ALL, &E);
+    ASSERT_NE(nullptr, video_source);
+    VP = FFMS_GetVideoProperties(video_source);
+    ASSERT_EQ(0, FFMS_SetVideoReadAhead(video_source, 16 * 1024, 4, &E));
+
+    // Every step backwards seeks and throws away what was read ahead
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    for (int num = VP->NumFrames - 1; num >= 0; num -= 5) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+
+    // Turning it off in the middle continues synchronously
+    ASSERT_EQ(0, FFMS_SetVideoReadAhead(video_source, 16 * 1024, 0, &E));
+    for (int num = 0; num < VP->NumFrames; num += 3) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, num), &P.TestData[num]));
+    }
+}
+
+TEST_P(IndexerTest, DecoderPoolThreads) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+
+    // What a source without a pool returns for every frame
+    std::vector<char> PictTypes(VP->NumFrames);
+    std::vector<int> KeyFrames(VP->NumFrames);
+    for (int num = 0; num < VP->NumFrames; num++) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, num, &E);
+        ASSERT_NE(nullptr, frame);
+        PictTypes[num] = frame->PictType;
+        KeyFrames[num] = frame->KeyFrame;
+    }
+
+    FFMS_VideoSource *pooled = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, &E);
+    ASSERT_NE(nullptr, pooled);
+    ASSERT_EQ(0, FFMS_SetVideoDecoderPoolSize(pooled, 3, &E));
+
+    const FFMS_Frame *first = FFMS_GetFrame(pooled, 0, &E);
+    ASSERT_NE(nullptr, first);
+    int Width = first->EncodedWidth;
+    int Height = first->EncodedHeight;
+    AVPixelFormat Format = (AVPixelFormat) first->ConvertedPixelFormat;
+
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+    const int NumThreads = 4;
+    std::vector<std::thread> Threads;
+    for (int t = 0; t < NumThreads; t++) {
+        Threads.emplace_back([&, t] {
+            FFMS_ErrorInfo ThreadE;
+            char ThreadMsg[1024];
+            ThreadE.Buffer = ThreadMsg;
+            ThreadE.BufferSize = sizeof(ThreadMsg);
+
+            uint8_t *Planes[4] = {};
+            int Strides[4] = {};
+            if (av_image_alloc(Planes, Strides, Width, Height, Format, 32) < 0) {
+                ADD_FAILURE() << "Could not allocate frame";
+                return;
+            }
+
+            // Every thread walks its own frames backwards and forwards so the decoders have to seek
+            for (int Pass = 0; Pass < 2; Pass++) {
+                for (int i = 0; i < VP->NumFrames; i++) {
+                    int num = Pass ? i : VP->NumFrames - 1 - i;
+                    if (num % NumThreads != t)
+                        continue;
+
+                    const FFMS_FrameInfo *info = FFMS_GetFrameInfo(track, num);
+                    const FFMS_Frame *frame;
+                    int Method = (num / NumThreads + Pass) % 3;
+                    if (Method == 0)
+                        frame = FFMS_GetFrame(pooled, num, &ThreadE);
+                    else if (Method == 1)
+                        frame = FFMS_GetFrameRef(pooled, num, &ThreadE);
+                    else
+                        frame = FFMS_GetFrameInto(pooled, num, Planes, Strides, &ThreadE);
+
+                    if (!frame) {
+                        ADD_FAILURE() << "Frame " << num << ": " << ThreadMsg;
+                        continue;
+                    }
+                    EXPECT_TRUE(CheckFrame(frame, info, &P.TestData[num])) << "Frame " << num;
+                    EXPECT_EQ(PictTypes[num], frame->PictType) << "Frame " << num;
+                    EXPECT_EQ(KeyFrames[num], frame->KeyFrame) << "Frame " << num;
+                    if (Method == 1)
+                        FFMS_ReleaseFrame(frame);
+                    else if (Method == 2)
+                        EXPECT_EQ(Planes[0], frame->Data[0]) << "Frame " << num;
+                }
+            }
+
+            av_freep(&Planes[0]);
+        });
+    }
+    for (auto &Thread : Threads)
+        Thread.join();
+
+    FFMS_DestroyVideoSource(pooled);
+}
+
+TEST_P(IndexerTest, PacketThenFrame) {
+    TestDataMap P = GetParam();
+    std::string FilePath = SamplesDir + "/" + P.Filename;
+
+    ASSERT_TRUE(DoIndexing(FilePath));
+    FFMS_Track *track = FFMS_GetTrackFromIndex(index, video_track_idx);
+
+    // Linear sources can't get back to where decoding was after reading packets
+    FFMS_VideoSource *linear = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_LINEAR, &E);
+    ASSERT_NE(nullptr, linear);
+    const uint8_t *Data;
+    int Size;
+    EXPECT_NE(0, FFMS_GetPacket(linear, 0, &Data, &Size, nullptr, &E));
+    FFMS_DestroyVideoSource(linear);
+
+    FFMS_VideoSource *fresh = FFMS_CreateVideoSource(FilePath.c_str(), video_track_idx, index, 1, FFMS_SEEK_NORMAL, &E);
+    ASSERT_NE(nullptr, fresh);
+
+    // Decoding continues correctly after a packet was read from somewhere else in the file
+    int num = VP->NumFrames / 3;
+    ASSERT_NE(nullptr, FFMS_GetFrame(video_source, num, &E));
+    ASSERT_EQ(0, FFMS_GetPacket(video_source, VP->NumFrames - 1, &Data, &Size, nullptr, &E));
+    for (int i = num + 1; i < VP->NumFrames && i < num + 10; i++) {
+        const FFMS_Frame *frame = FFMS_GetFrame(video_source, i, &E);
+        ASSERT_NE(nullptr, frame);
+        ASSERT_TRUE(CheckFrame(frame, FFMS_GetFrameInfo(track, i), &P.TestData[i]));
+        char PictType = frame->PictType;
+        const FFMS_Frame *expected = FFMS_GetFrame(fresh, i, &E);
+        ASSERT_NE(nullptr, expected);
+        EXPECT_EQ(expected->PictType, PictType);
+    }
+
+    FFMS_DestroyVideoSource(fresh);
+}
+
 INSTANTIATE_TEST_CASE_P(ValidateIndexer, IndexerTest, ::testing::ValuesIn(TestFiles));
 
 } //namespace